@@ -0,0 +1,355 @@
+/** @file
+ *  @brief Microbenchmarks of the runtime primitives
+ *
+ *  Each task measures one group of operations and transitions to the next.
+ *  The report is printed as CSV (see bench.h) when all measurements are done.
+ */
+
+#include <stdlib.h>
+
+#include <libchain/chain.h>
+
+#include "bench.h"
+
+#define SELF_FIELDS 32 // power of 2, for SELF_FIELD_ARRAY_INITIALIZER
+
+struct msg_x {
+    CHAN_FIELD(unsigned, x);
+};
+
+struct msg_self {
+    SELF_CHAN_FIELD_ARRAY(unsigned, f, SELF_FIELDS);
+};
+#define FIELD_INIT_msg_self { \
+    SELF_FIELD_ARRAY_INITIALIZER(SELF_FIELDS) \
+}
+
+#define LOOP_ITERS 256
+
+struct msg_loop {
+    SELF_CHAN_FIELD(unsigned, i);
+    SELF_CHAN_FIELD(unsigned, sum);
+};
+#define FIELD_INIT_msg_loop { \
+    SELF_FIELD_INITIALIZER, \
+    SELF_FIELD_INITIALIZER, \
+}
+
+TASK(1, task_setup)
+TASK(2, task_in)
+TASK(3, task_out)
+TASK(4, task_transition)
+TASK(5, task_call)
+TASK(6, task_callee)
+TASK(7, task_hot)
+TASK(8, task_dirty)
+TASK(9, task_loop)
+TASK(10, task_age)
+TASK(11, task_boot)
+TASK(12, task_report)
+
+/* Channels into task_in from tasks that exist only as channel endpoints */
+CHANNEL(task_setup, task_in, msg_x);
+CHANNEL(task_src1, task_in, msg_x);
+CHANNEL(task_src2, task_in, msg_x);
+CHANNEL(task_src3, task_in, msg_x);
+CHANNEL(task_src4, task_in, msg_x);
+
+CHANNEL(task_out, task_sink, msg_x);
+MULTICAST_CHANNEL(msg_x, ch_mc, task_out, task_sink, task_sink2);
+SELF_CHANNEL(task_out, msg_self);
+SELF_CHANNEL(task_dirty, msg_self);
+SELF_CHANNEL(task_loop, msg_loop);
+SELF_CHANNEL(task_hot, msg_loop);
+
+static const unsigned dirty_counts[] = { 0, 1, 2, 4, 8, 16, 32 };
+static const char *dirty_names[] = {
+    "transition_dirty_0", "transition_dirty_1", "transition_dirty_2",
+    "transition_dirty_4", "transition_dirty_8", "transition_dirty_16",
+    "transition_dirty_32",
+};
+#define NUM_DIRTY_COUNTS (sizeof(dirty_counts) / sizeof(dirty_counts[0]))
+
+static const char *loop_names[] = { "loop_256_single", "loop_256_batch" };
+
+/* Measurement that started before a transition, stopped in the next task */
+static bench_result_t *pending;
+static unsigned dirty_idx;
+static unsigned loop_idx;
+static int loop_running;
+static int hot_ready;
+static int out_warm;
+static unsigned aged;
+static int rebooting BENCH_NOINIT;
+
+static volatile unsigned sink;
+
+void init()
+{
+#ifndef LIBCHAIN_HOST
+    WDTCTL = WDTPW | WDTHOLD;
+    PM5CTL0 &= ~LOCKLPM5;
+#endif // !LIBCHAIN_HOST
+    bench_timer_init();
+    bench_calibrate();
+}
+
+static inline void stop_pending()
+{
+    if (pending) {
+        bench_stop(pending);
+        pending = NULL;
+    }
+}
+
+void task_setup()
+{
+    unsigned x = 1;
+
+    bench_reset();
+    rebooting = 0;
+
+    CHAN_OUT5(unsigned, x, x, CH(task_setup, task_in), CH(task_src1, task_in),
+              CH(task_src2, task_in), CH(task_src3, task_in), CH(task_src4, task_in));
+    TRANSITION_TO(task_in);
+}
+
+void task_in()
+{
+    BENCH_OP("chan_in_1", sink = *CHAN_IN1(unsigned, x, CH(task_setup, task_in)));
+    BENCH_OP("chan_in_2", sink = *CHAN_IN2(unsigned, x, CH(task_setup, task_in),
+                                           CH(task_src1, task_in)));
+    BENCH_OP("chan_in_3", sink = *CHAN_IN3(unsigned, x, CH(task_setup, task_in),
+                                           CH(task_src1, task_in), CH(task_src2, task_in)));
+    BENCH_OP("chan_in_4", sink = *CHAN_IN4(unsigned, x, CH(task_setup, task_in),
+                                           CH(task_src1, task_in), CH(task_src2, task_in),
+                                           CH(task_src3, task_in)));
+    BENCH_OP("chan_in_5", sink = *CHAN_IN5(unsigned, x, CH(task_setup, task_in),
+                                           CH(task_src1, task_in), CH(task_src2, task_in),
+                                           CH(task_src3, task_in), CH(task_src4, task_in)));
+    TRANSITION_TO(task_out);
+}
+
+void task_out()
+{
+    unsigned x = 2;
+    unsigned i = 0;
+
+    // The first write ever of a variable lists it in the table of
+    // timestamps: write both buffers of the self-channel fields beforehand
+    if (out_warm < 2) {
+        for (unsigned k = 0; k < SELF_FIELDS; ++k)
+            CHAN_OUT1(unsigned, f[k], x, SELF_OUT_CH(task_out));
+        ++out_warm;
+        TRANSITION_TO(task_out);
+    }
+
+    BENCH_OP("chan_out_t2t", CHAN_OUT1(unsigned, x, x, CH(task_out, task_sink)));
+    BENCH_OP("chan_out_mc", CHAN_OUT1(unsigned, x, x,
+                                      MC_OUT_CH(ch_mc, task_out, task_sink, task_sink2)));
+    BENCH_OP("chan_out_begin_commit_t2t", {
+        *CHAN_OUT_BEGIN(unsigned, x, CH(task_out, task_sink)) = x;
+        CHAN_OUT_COMMIT(unsigned, x, CH(task_out, task_sink));
+    });
+
+    // First write of a field in an execution lists it as dirty
+    BENCH_OP("chan_out_self", {
+        CHAN_OUT1(unsigned, f[i % SELF_FIELDS], x, SELF_OUT_CH(task_out));
+        ++i;
+    });
+    BENCH_OP("chan_out_self_again", CHAN_OUT1(unsigned, f[0], x, SELF_OUT_CH(task_out)));
+
+    TRANSITION_TO(task_transition);
+}
+
+void task_transition()
+{
+    stop_pending();
+
+    bench_result_t *r = bench_result("transition");
+    if (bench_more(r)) {
+        pending = r;
+        bench_start(r);
+        TRANSITION_TO(task_transition);
+    }
+
+    TRANSITION_TO(task_call);
+}
+
+/* Call of a task that returns right away: the call and the return are
+ * measured separately, to compare each with a plain transition */
+void task_call()
+{
+    stop_pending();
+
+    bench_result_t *r = bench_result("transition_call");
+    if (bench_more(r) || bench_more(bench_result("transition_return"))) {
+        if (bench_more(r)) {
+            pending = r;
+            bench_start(r);
+        }
+        TRANSITION_CALL(task_callee, task_call);
+    }
+
+    TRANSITION_TO(task_hot);
+}
+
+void task_callee()
+{
+    stop_pending();
+
+    bench_result_t *r = bench_result("transition_return");
+    if (bench_more(r)) {
+        pending = r;
+        bench_start(r);
+    }
+    TRANSITION_RETURN();
+}
+
+/* Channel-intensive execution that reads and writes the same two fields
+ * repeatedly, measured up to the transition that publishes the writes */
+void task_hot()
+{
+    stop_pending();
+
+    if (!hot_ready) {
+        unsigned zero = 0;
+        CHAN_OUT1(unsigned, i, zero, SELF_OUT_CH(task_hot));
+        CHAN_OUT1(unsigned, sum, zero, SELF_OUT_CH(task_hot));
+        hot_ready = 1;
+        TRANSITION_TO(task_hot);
+    }
+
+    bench_result_t *r = bench_result("transition_rw_8");
+    if (bench_more(r)) {
+        pending = r;
+        bench_start(r);
+        for (unsigned k = 0; k < 8; ++k) {
+            unsigned i = *CHAN_IN1(unsigned, i, SELF_IN_CH(task_hot));
+            unsigned sum = *CHAN_IN1(unsigned, sum, SELF_IN_CH(task_hot)) + i + k;
+            CHAN_OUT1(unsigned, i, i, SELF_OUT_CH(task_hot));
+            CHAN_OUT1(unsigned, sum, sum, SELF_OUT_CH(task_hot));
+        }
+        TRANSITION_TO(task_hot);
+    }
+
+    TRANSITION_TO(task_dirty);
+}
+
+/* Transition to self after writing the given number of self-channel fields */
+void task_dirty()
+{
+    stop_pending();
+
+    while (dirty_idx < NUM_DIRTY_COUNTS) {
+        bench_result_t *r = bench_result(dirty_names[dirty_idx]);
+
+        if (bench_more(r)) {
+            for (unsigned k = 0; k < dirty_counts[dirty_idx]; ++k)
+                CHAN_OUT1(unsigned, f[k], k, SELF_OUT_CH(task_dirty));
+
+            pending = r;
+            bench_start(r);
+            TRANSITION_TO(task_dirty);
+        }
+
+        ++dirty_idx;
+    }
+
+    TRANSITION_TO(task_loop);
+}
+
+/* Sum of a sequence with the induction state in a self-channel, one
+ * iteration per execution, and then in batches tuned by the runtime */
+void task_loop()
+{
+    unsigned i, sum;
+
+    if (!loop_running) {
+        while (loop_idx < 2 && !bench_more(bench_result(loop_names[loop_idx])))
+            ++loop_idx;
+        if (loop_idx == 2)
+            TRANSITION_TO(task_age);
+
+        i = sum = 0;
+        CHAN_OUT1(unsigned, i, i, SELF_OUT_CH(task_loop));
+        CHAN_OUT1(unsigned, sum, sum, SELF_OUT_CH(task_loop));
+
+        loop_running = 1;
+        bench_start(bench_result(loop_names[loop_idx]));
+        TRANSITION_TO(task_loop);
+    }
+
+    i = *CHAN_IN1(unsigned, i, SELF_IN_CH(task_loop));
+    sum = *CHAN_IN1(unsigned, sum, SELF_IN_CH(task_loop));
+
+    if (i == LOOP_ITERS) {
+        bench_stop(bench_result(loop_names[loop_idx]));
+        sink = sum;
+        loop_running = 0;
+        TRANSITION_TO(task_loop);
+    }
+
+    if (loop_idx == 0) {
+        sum += i;
+        ++i;
+    } else {
+        BATCH_LOOP(i < LOOP_ITERS) {
+            sum += i;
+            ++i;
+        }
+    }
+
+    CHAN_OUT1(unsigned, i, i, SELF_OUT_CH(task_loop));
+    CHAN_OUT1(unsigned, sum, sum, SELF_OUT_CH(task_loop));
+    TRANSITION_TO(task_loop);
+}
+
+/* Reads of values written earlier than the horizon of logical time, which
+ * the runtime orders on a slow path when more than one channel has one */
+void task_age()
+{
+    if (aged < CHAIN_TIME_HORIZON) {
+        ++aged;
+        TRANSITION_TO(task_age);
+    }
+
+    BENCH_OP("chan_in_1_old", sink = *CHAN_IN1(unsigned, x, CH(task_setup, task_in)));
+    BENCH_OP("chan_in_2_old", sink = *CHAN_IN2(unsigned, x, CH(task_setup, task_in),
+                                               CH(task_src1, task_in)));
+
+    TRANSITION_TO(task_boot);
+}
+
+/* Reboot into the interrupted task: the path from reset (the entry point,
+ * init, and the restart of the task) that precedes every resumption */
+void task_boot()
+{
+    bench_result_t *r = bench_result("boot");
+
+    if (rebooting) {
+        bench_stop(r);
+        rebooting = 0;
+    }
+    if (bench_more(r)) {
+        rebooting = 1;
+        bench_start(r);
+        bench_reboot();
+    }
+
+    TRANSITION_TO(task_report);
+}
+
+void task_report()
+{
+    bench_report();
+    exit(0);
+}
+
+ENTRY_TASK(task_setup)
+
+int main()
+{
+    init();
+    return chain_main();
+}
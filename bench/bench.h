@@ -0,0 +1,226 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/** @file
+ *  @brief Measurement of the cost of runtime primitives
+ *
+ *  A measured operation is bracketed by bench_start and bench_stop, which may
+ *  be in different tasks (to measure a transition). Each operation is timed
+ *  over some number of repetitions and then run once more while counting
+ *  accesses to non-volatile memory, so that the counting does not distort
+ *  the times.
+ *
+ *  On MSP430, time is measured in ticks of Timer A0 clocked by SMCLK, which
+ *  equal CPU cycles when SMCLK and MCLK have the same source and divider (as
+ *  after reset), extended to 32 bits by counting the overflows of the timer
+ *  in its interrupt. NV accesses are not counted on MSP430.
+ *
+ *  On the host, time is measured in TSC ticks and NV accesses are counted by
+ *  the host backend (see chain_host_count_nv).
+ *
+ *  A reboot is measured from bench_reboot, which simulates a power failure on
+ *  the host and branches to the reset entry point on MSP430 (the hardware
+ *  reset itself is not measured), to the start of the task.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef LIBCHAIN_HOST
+#include <libchain/host.h>
+#include <x86intrin.h>
+
+typedef uint64_t bench_time_t;
+
+static inline void bench_timer_init() {}
+static inline bench_time_t bench_now() { return __rdtsc(); }
+
+#define BENCH_COUNTS_NV 1
+static inline void bench_count_nv(int enable) { chain_host_count_nv(enable); }
+static inline void bench_nv_counts(unsigned long *reads, unsigned long *writes)
+{
+    chain_host_nv_counts(reads, writes);
+}
+
+/* The backend keeps SRAM across simulated power failures */
+#define BENCH_NOINIT
+static inline void bench_reboot() { chain_host_power_failure(); }
+#else // !LIBCHAIN_HOST
+#include <msp430.h>
+
+/* The reset path initializes .data and .bss, but not .noinit */
+#define BENCH_NOINIT __attribute__((section(".noinit")))
+
+typedef uint32_t bench_time_t;
+
+/* High word of the time: kept, like the timer, across bench_reboot */
+static volatile uint16_t bench_timer_high BENCH_NOINIT;
+
+__attribute__((interrupt(TIMER0_A1_VECTOR)))
+void bench_timer_isr()
+{
+    if (__even_in_range(TA0IV, TA0IV_TAIFG) == TA0IV_TAIFG)
+        ++bench_timer_high;
+}
+
+/** @brief Start the timer, unless it runs already (after bench_reboot) */
+static inline void bench_timer_init()
+{
+    if ((TA0CTL & MC_3) != MC__CONTINUOUS) {
+        bench_timer_high = 0;
+        TA0CTL = TASSEL__SMCLK | MC__CONTINUOUS | TACLR | TAIE;
+    }
+    __enable_interrupt();
+}
+
+/** @brief Time in cycles: the high word is read again if the timer overflowed */
+static inline bench_time_t bench_now()
+{
+    uint16_t high, low;
+
+    do {
+        high = bench_timer_high;
+        low = TA0R;
+    } while (high != bench_timer_high);
+    return ((uint32_t)high << 16) | low;
+}
+
+#define BENCH_COUNTS_NV 0
+static inline void bench_count_nv(int enable) {}
+static inline void bench_nv_counts(unsigned long *reads, unsigned long *writes)
+{
+    *reads = *writes = 0;
+}
+
+/** @brief Branch to the reset entry point, which Timer A0 runs through */
+static inline void bench_reboot()
+{
+#ifdef LIBCHAIN_ENABLE_ENTRY
+    __asm__ volatile ("br #chain_start\n");
+#else // !LIBCHAIN_ENABLE_ENTRY
+    __asm__ volatile ("br #_start\n"); // crt0
+#endif // !LIBCHAIN_ENABLE_ENTRY
+}
+#endif // !LIBCHAIN_HOST
+
+/** @brief Accumulated measurement of one operation */
+typedef struct {
+    const char *name;
+    unsigned reps;          // number of timed repetitions
+    uint32_t time;          // total time of the timed repetitions
+    unsigned long nv_reads; // in the counted repetition
+    unsigned long nv_writes;
+    int done;               // counted repetition finished
+} bench_result_t;
+
+/** @brief Number of timed repetitions of each operation */
+#define BENCH_REPS 16
+
+#define BENCH_MAX_RESULTS 32
+
+/* Measurements live in volatile memory: benchmarks run on continuous power,
+ * and reboot only through bench_reboot, which keeps .noinit */
+static bench_result_t bench_results[BENCH_MAX_RESULTS] BENCH_NOINIT;
+static unsigned bench_num_results BENCH_NOINIT;
+static bench_time_t bench_overhead BENCH_NOINIT;
+
+static bench_time_t bench_t0 BENCH_NOINIT;
+static unsigned long bench_reads0 BENCH_NOINIT, bench_writes0 BENCH_NOINIT;
+static int bench_counting BENCH_NOINIT;
+
+/** @brief Clear the results, once at the start (.noinit is not zeroed) */
+static inline void bench_reset()
+{
+    for (unsigned i = 0; i < BENCH_MAX_RESULTS; ++i)
+        bench_results[i] = (bench_result_t){ 0 };
+    bench_num_results = 0;
+}
+
+/** @brief Get the result record for an operation, creating it on first use */
+static inline bench_result_t *bench_result(const char *name)
+{
+    for (unsigned i = 0; i < bench_num_results; ++i)
+        if (bench_results[i].name == name)
+            return &bench_results[i];
+
+    bench_result_t *r = &bench_results[bench_num_results++];
+    r->name = name;
+    return r;
+}
+
+/** @brief Start a repetition: timed if fewer than BENCH_REPS were, else counted */
+static inline void bench_start(bench_result_t *r)
+{
+    bench_counting = r->reps == BENCH_REPS;
+    if (bench_counting) {
+        bench_nv_counts(&bench_reads0, &bench_writes0);
+        bench_count_nv(1);
+    }
+    bench_t0 = bench_now();
+}
+
+static inline void bench_stop(bench_result_t *r)
+{
+    bench_time_t t1 = bench_now();
+
+    if (bench_counting) {
+        unsigned long reads, writes;
+        bench_count_nv(0);
+        bench_nv_counts(&reads, &writes);
+        r->nv_reads = reads - bench_reads0;
+        r->nv_writes = writes - bench_writes0;
+        r->done = 1;
+    } else {
+        bench_time_t t = t1 - bench_t0;
+        // An operation that the compiler reduced to a few instructions can
+        // take less than the calibrated overhead
+        r->time += t > bench_overhead ? t - bench_overhead : 0;
+        ++r->reps;
+    }
+}
+
+/** @brief Whether the operation needs more repetitions (timed or counted) */
+static inline int bench_more(bench_result_t *r)
+{
+    return !r->done;
+}
+
+/** @brief Measure an operation that runs within a task */
+#define BENCH_OP(name, op) do { \
+        bench_result_t *_r = bench_result(name); \
+        while (bench_more(_r)) { \
+            bench_start(_r); \
+            op; \
+            bench_stop(_r); \
+        } \
+    } while (0)
+
+/** @brief Measure the overhead of an empty measurement */
+static inline void bench_calibrate()
+{
+    bench_time_t t0 = bench_now();
+    bench_time_t t1 = bench_now();
+    bench_overhead = t1 - t0;
+}
+
+/** @brief Print the results as CSV rows: per-operation averages */
+static inline void bench_report_rows()
+{
+    for (unsigned i = 0; i < bench_num_results; ++i) {
+        bench_result_t *r = &bench_results[i];
+        printf("%s,%u,%lu,", r->name, r->reps, (unsigned long)(r->time / r->reps));
+        if (BENCH_COUNTS_NV)
+            printf("%lu,%lu\n", r->nv_reads, r->nv_writes);
+        else
+            printf("-,-\n");
+    }
+}
+
+/** @brief Print the results as CSV, with a header line */
+static inline void bench_report()
+{
+    printf("op,reps,cycles,nv_reads,nv_writes\n");
+    bench_report_rows();
+}
+
+#endif // BENCH_H
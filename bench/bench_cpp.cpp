@@ -0,0 +1,107 @@
+/** @file
+ *  @brief Microbenchmarks of the C++ front end (chain.hpp)
+ *
+ *  The same channel reads and writes as the C benchmark, through chain::in
+ *  and chain::out, so that the rows compare with chan_in_N and chan_out_t2t.
+ *  The report is printed as CSV (see bench.h), without the header line, to
+ *  be appended to the report of the C benchmark.
+ */
+
+#include <stdlib.h>
+
+#include <libchain/chain.hpp>
+
+#include "bench.h"
+
+struct msg_x {
+    CHAN_FIELD(unsigned, x);
+};
+
+TASK(1, task_setup)
+TASK(2, task_in)
+TASK(3, task_out)
+TASK(4, task_report)
+
+/* Channels into task_in from tasks that exist only as channel endpoints */
+CHANNEL(task_setup, task_in, msg_x);
+CHANNEL(task_src1, task_in, msg_x);
+CHANNEL(task_src2, task_in, msg_x);
+CHANNEL(task_src3, task_in, msg_x);
+CHANNEL(task_src4, task_in, msg_x);
+
+CHANNEL(task_out, task_sink1, msg_x);
+CHANNEL(task_out, task_sink2, msg_x);
+CHANNEL(task_out, task_sink3, msg_x);
+CHANNEL(task_out, task_sink4, msg_x);
+CHANNEL(task_out, task_sink5, msg_x);
+
+static volatile unsigned sink;
+
+extern "C" void init()
+{
+#ifndef LIBCHAIN_HOST
+    WDTCTL = WDTPW | WDTHOLD;
+    PM5CTL0 &= ~LOCKLPM5;
+#endif // !LIBCHAIN_HOST
+    bench_timer_init();
+    bench_calibrate();
+}
+
+void task_setup()
+{
+    unsigned x = 1;
+
+    bench_reset();
+
+    chain::out<&msg_x::x>(x, CH(task_setup, task_in), CH(task_src1, task_in),
+                          CH(task_src2, task_in), CH(task_src3, task_in), CH(task_src4, task_in));
+    TRANSITION_TO(task_in);
+}
+
+void task_in()
+{
+    BENCH_OP("cpp_in_1", sink = *chain::in<&msg_x::x>(CH(task_setup, task_in)));
+    BENCH_OP("cpp_in_2", sink = *chain::in<&msg_x::x>(CH(task_setup, task_in),
+                                                       CH(task_src1, task_in)));
+    BENCH_OP("cpp_in_3", sink = *chain::in<&msg_x::x>(CH(task_setup, task_in),
+                                                       CH(task_src1, task_in), CH(task_src2, task_in)));
+    BENCH_OP("cpp_in_4", sink = *chain::in<&msg_x::x>(CH(task_setup, task_in),
+                                                       CH(task_src1, task_in), CH(task_src2, task_in),
+                                                       CH(task_src3, task_in)));
+    BENCH_OP("cpp_in_5", sink = *chain::in<&msg_x::x>(CH(task_setup, task_in),
+                                                       CH(task_src1, task_in), CH(task_src2, task_in),
+                                                       CH(task_src3, task_in), CH(task_src4, task_in)));
+    TRANSITION_TO(task_out);
+}
+
+void task_out()
+{
+    unsigned x = 2;
+
+    BENCH_OP("cpp_out_1", chain::out<&msg_x::x>(x, CH(task_out, task_sink1)));
+    BENCH_OP("cpp_out_2", chain::out<&msg_x::x>(x, CH(task_out, task_sink1),
+                                                CH(task_out, task_sink2)));
+    BENCH_OP("cpp_out_3", chain::out<&msg_x::x>(x, CH(task_out, task_sink1),
+                                                CH(task_out, task_sink2), CH(task_out, task_sink3)));
+    BENCH_OP("cpp_out_4", chain::out<&msg_x::x>(x, CH(task_out, task_sink1),
+                                                CH(task_out, task_sink2), CH(task_out, task_sink3),
+                                                CH(task_out, task_sink4)));
+    BENCH_OP("cpp_out_5", chain::out<&msg_x::x>(x, CH(task_out, task_sink1),
+                                                CH(task_out, task_sink2), CH(task_out, task_sink3),
+                                                CH(task_out, task_sink4), CH(task_out, task_sink5)));
+    TRANSITION_TO(task_report);
+}
+
+void task_report()
+{
+    bench_report_rows();
+    exit(0);
+}
+
+ENTRY_TASK(task_setup)
+
+int main()
+{
+    init();
+    return chain_main();
+}
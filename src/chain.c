@@ -10,314 +10,2217 @@
 
 #include "chain.h"
 
+#ifdef LIBCHAIN_HOST
+#include <stdio.h>
+#include <stdlib.h>
+#define FAIL_POINT() chain_host_fail_point()
+#else // !LIBCHAIN_HOST
+#include <msp430.h>
+#define FAIL_POINT()
+#endif // !LIBCHAIN_HOST
+
+/** @brief Unrecoverable error in the application: stop */
+#ifdef LIBCHAIN_HOST
+#define LIBCHAIN_FATAL(msg) do { fputs("libchain: " msg "\n", stderr); abort(); } while (0)
+#else // !LIBCHAIN_HOST
+#define LIBCHAIN_FATAL(msg) while (1)
+#endif // !LIBCHAIN_HOST
+
+/** @brief Add to a performance counter of a task */
+#ifdef LIBCHAIN_ENABLE_COUNTERS
+#define COUNT(task, counter, n) ((task)->counters->counter += (n))
+#else // !LIBCHAIN_ENABLE_COUNTERS
+#define COUNT(task, counter, n) do {} while (0)
+#endif // !LIBCHAIN_ENABLE_COUNTERS
+
+/** @brief Round a size up to the alignment of variables in a redo or undo log */
+#define SELF_LOG_ALIGN(size) \
+    (((size) + sizeof(var_meta_t) - 1) & ~(sizeof(var_meta_t) - 1))
+
+/** @brief Atomically swap the bytes of the index pair of a self-channel field
+ *  @details On MSP430 this is a single instruction, so a power failure
+ *           cannot tear it. On the host the failure points are only
+ *           between statements, so the C expression is just as atomic.
+ */
+#ifdef LIBCHAIN_HOST
+#define SWAP_IDX_PAIR(self_field) \
+    (self_field)->idx_pair = (((self_field)->idx_pair & 0x00ffU) << 8) | \
+                             (((self_field)->idx_pair & 0xff00U) >> 8)
+#else // !LIBCHAIN_HOST
+#define SWAP_IDX_PAIR(self_field) \
+    __asm__ volatile ( \
+        "SWPB %[idx_pair]\n" \
+        : [idx_pair]  "=m" ((self_field)->idx_pair) \
+    )
+#endif // !LIBCHAIN_HOST
+
 /* Dummy types for offset calculations */
 struct _void_type_t {
     void * x;
 };
 typedef struct _void_type_t void_type_t;
 
-__nv chain_time_t volatile curtime = 0;
+#ifdef LIBCHAIN_ENABLE_SLEEP
+/** @brief Persistent clock (see chain_clock)
+ *  @details Double-buffered, because the value takes two words on MSP430:
+ *           the single-word write of the slot index commits an update.
+ */
+__nv uint32_t clock_slots[2] = { 0, 0 };
+__nv volatile unsigned clock_slot = 0;
+
+/** @brief Deferred transition: the execution at the logical time waits for
+ *         the deadline (see TRANSITION_AFTER)
+ */
+typedef struct {
+    volatile uint32_t deadline;
+    volatile chain_time_t time;
+} chain_wait_t;
+
+__nv chain_wait_t chain_wait;
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+/* To update the context, fill-in the slot other than the current one */
+__nv context_t contexts[2] = {
+    { .time = 1, .task = CONTEXT_ENTRY_TASK | CONTEXT_PROLOGUE },
+    { .time = (chain_time_t)-1, .task = CONTEXT_ENTRY_TASK },
+};
+
+context_t * volatile curctx = &contexts[0];
+const task_t *chain_task;
+
+/* Call depth held by each slot, so that a transition writes it only when
+ * it changes */
+static unsigned context_call_depth[2];
+
+/* Logical time and era of the current context, derived on boot */
+chain_time_t chain_now;
+static uint32_t era;
+
+/** @brief The logical time that follows the given one: 0 is skipped */
+static inline chain_time_t time_next(chain_time_t time)
+{
+    chain_time_t next = time + 1;
+    return next ? next : 1;
+}
+
+/** @brief The logical time that precedes the given one: 0 is skipped */
+static inline chain_time_t time_prev(chain_time_t time)
+{
+    return time == 1 ? (chain_time_t)-1 : time - 1;
+}
+
+#if !LIBCHAIN_STAMP_SWEEP_INTERVAL || \
+    (LIBCHAIN_STAMP_SWEEP_INTERVAL & (LIBCHAIN_STAMP_SWEEP_INTERVAL - 1))
+#error LIBCHAIN_STAMP_SWEEP_INTERVAL must be a power of two
+#endif
+/* A pass visits every entry and then runs the runtime step. The bounds
+ * follow from CHAIN_TIME_HORIZON (0xa000): see LIBCHAIN_STAMPS. */
+#define STAMP_SWEEP_PASS ((LIBCHAIN_STAMPS + 1) * LIBCHAIN_STAMP_SWEEP_INTERVAL)
+#if 2 * STAMP_SWEEP_PASS >= 0xa000 - 1 || STAMP_SWEEP_PASS >= 0x10000 - 0xa000 - 1
+#error (LIBCHAIN_STAMPS + 1) * LIBCHAIN_STAMP_SWEEP_INTERVAL must be less than 0x5000 transitions
+#endif
+
+/** @brief Entry of the table of timestamps (see LIBCHAIN_STAMPS) */
+typedef struct {
+    var_meta_t *var;
+    uint64_t time;  // full logical time of the latest write seen by the sweep
+} stamp_t;
+
+/** @brief Table of timestamps
+ *  @details Entries are appended on the first write of a variable, and
+ *           never removed. The sweep position persists, so that the sweep
+ *           keeps its pace across reboots.
+ */
+typedef struct {
+    volatile unsigned count;
+    volatile unsigned next;     // entry visited by the next step of the sweep
+    stamp_t stamps[LIBCHAIN_STAMPS];
+} stamp_table_t;
+
+__nv stamp_table_t stamp_table;
+
+/* Full logical time: the era and the time within it */
+#define FULL_TIME(era, time) (((uint64_t)(era) << 16) | (time))
+
+// for internal instrumentation purposes
+__nv volatile unsigned _numBoots = 0;
+
+/* Table of FIFO channels (see FIFO_TABLE_ATTR), empty if there are none */
+extern fifo_t * const __start_chain_fifos[] __attribute__((weak));
+extern fifo_t * const __stop_chain_fifos[] __attribute__((weak));
+
+/* Whether the current execution of the task ran a BATCH_LOOP */
+static unsigned batch_running;
+
+/* Whether the transition being made is a deferred one */
+static unsigned wait_requested;
+
+/* Tag of volatile channels written in this boot: the boot count, never 0 */
+static unsigned boot_epoch;
+
+/* Header of a volatile channel, which precedes the channel */
+#define VOLATILE_CHAN_META(chan) \
+    ((volatile_chan_meta_t *)((uint8_t *)(chan) - sizeof(volatile_chan_meta_t)))
+
+const int chain_chan_hooks = CHAIN_CHAN_HOOKS;
+
+/** @brief Call stack: return tasks of the calls in progress
+ *  @details Entries at and above the depth in the current context are free,
+ *           so a call writes its entry before the transition commits it.
+ */
+__nv const task_t *call_stack[LIBCHAIN_CALL_DEPTH];
+
+/* Call depth of the context that the next transition commits */
+static unsigned call_depth;
+
+#if LIBCHAIN_EVENT_QUEUE_SIZE & (LIBCHAIN_EVENT_QUEUE_SIZE - 1)
+#error LIBCHAIN_EVENT_QUEUE_SIZE must be a power of two
+#endif
+
+/** @brief Queue of the events of one priority level
+ *  @details Single producer (chain_event_post), single consumer (the
+ *           dispatcher). Positions run freely and wrap around with the
+ *           unsigned type, which the power-of-two size divides.
+ */
+typedef struct {
+    chain_event_t events[LIBCHAIN_EVENT_QUEUE_SIZE];
+    volatile unsigned head; // written only by the dispatcher
+    volatile unsigned tail; // written only by chain_event_post
+} event_queue_t;
+
+/** @brief The event being handled and the task that it preempted
+ *  @details The handler runs from the logical time start up to the logical
+ *           time end, exclusive. While the handler runs, the end is the
+ *           time that precedes the start (see time_prev), and the record is
+ *           written only while no handler runs, so it is committed by the
+ *           transition into the handler, along with the removal of the event
+ *           from the queue.
+ */
+typedef struct {
+    chain_event_t event;
+    const task_t *resume;           // destination of the preempted transition
+    unsigned level;                 // priority level of the event
+    unsigned head;                  // head of its queue after removing it
+    volatile chain_time_t start;    // of the first task of the handler
+    volatile chain_time_t end;      // of the task resumed after it
+} event_dispatch_t;
+
+__nv event_queue_t event_queues[LIBCHAIN_EVENT_PRIORITIES];
+__nv event_dispatch_t event_dispatch_state;
+
+/* Whether the queues may hold an event: set by chain_event_post and on boot */
+static volatile unsigned events_pending;
+
+/* Table of event handlers (see EVENT_TABLE_ATTR), empty if there are none */
+extern const event_handler_t __start_chain_events[] __attribute__((weak));
+extern const event_handler_t __stop_chain_events[] __attribute__((weak));
+
+#ifdef LIBCHAIN_ENABLE_CACHE
+static void cache_write_back();
+static void cache_reset();
+#define CACHE_WRITE_BACK() cache_write_back()
+#define CACHE_RESET() cache_reset()
+#else // !LIBCHAIN_ENABLE_CACHE
+#define CACHE_WRITE_BACK()
+#define CACHE_RESET()
+#endif // !LIBCHAIN_ENABLE_CACHE
+
+#ifdef LIBCHAIN_ENABLE_TRACE
+__nv chain_trace_t chain_trace = {
+    .magic = CHAIN_TRACE_MAGIC,
+    .rec_size = sizeof(chain_trace_rec_t),
+    .capacity = LIBCHAIN_TRACE_SIZE,
+};
+
+/** @brief Append a record to the trace
+ *  @details A power failure before the index is advanced loses the record.
+ */
+static void trace(chain_trace_kind_t kind, const task_t *task, void *chan, size_t field)
+{
+    unsigned next = chain_trace.next;
+    chain_trace_rec_t *rec = &chain_trace.recs[next];
+
+    rec->task = (uint32_t)(uintptr_t)task;
+    rec->chan = (uint32_t)(uintptr_t)chan;
+    rec->time = curctx->time;
+    rec->boot = _numBoots;
+    rec->field = field;
+    rec->kind = kind;
+
+    if (++next == LIBCHAIN_TRACE_SIZE) {
+        next = 0;
+        chain_trace.wrapped = 1;
+    }
+    chain_trace.next = next;
+}
+#define TRACE(kind, task, chan, field) trace(kind, task, chan, field)
+#else // !LIBCHAIN_ENABLE_TRACE
+#define TRACE(kind, task, chan, field)
+#endif // !LIBCHAIN_ENABLE_TRACE
+
+#ifdef LIBCHAIN_ENABLE_PROFILE
+__nv chain_profile_t chain_profile = {
+    .magic = CHAIN_PROFILE_MAGIC,
+    .site_size = sizeof(chain_profile_site_t),
+    .capacity = LIBCHAIN_PROFILE_SITES,
+};
+
+#ifdef LIBCHAIN_HOST
+#include <x86intrin.h>
+
+static inline void profile_timer_init() {}
+static inline uint32_t profile_now() { return (uint32_t)__rdtsc(); }
+#else // !LIBCHAIN_HOST
+#include <stdio.h>
+
+#define PROFILE_TIMER_REG_(n, reg) TA ## n ## reg
+#define PROFILE_TIMER_REG(reg) PROFILE_TIMER_REG_(LIBCHAIN_PROFILE_TIMER, reg)
+
+static uint16_t profile_timer_high;
+
+static void profile_timer_init()
+{
+    PROFILE_TIMER_REG(CTL) = TASSEL__SMCLK | ID__8 | MC__CONTINUOUS | TACLR;
+}
+
+/** @brief Time in cycles, extended to 32 bits by polling the overflow flag
+ *  @details The timer counts SMCLK/8, so an overflow is missed only if the
+ *           task does not call into the runtime for 2^19 cycles.
+ */
+static uint32_t profile_now()
+{
+    uint16_t low = PROFILE_TIMER_REG(R);
+
+    if (PROFILE_TIMER_REG(CTL) & TAIFG) {
+        PROFILE_TIMER_REG(CTL) &= ~TAIFG;
+        ++profile_timer_high;
+        low = PROFILE_TIMER_REG(R);
+    }
+    return (((uint32_t)profile_timer_high << 16) | low) << 3;
+}
+#endif // !LIBCHAIN_HOST
+
+/* Point of a measurement: time and NV accesses, without the profiler's own */
+typedef struct {
+    uint32_t time;
+    unsigned long reads;
+    unsigned long writes;
+} profile_sample_t;
+
+static struct {
+    profile_sample_t task_start;
+    profile_sample_t site_start;
+    const task_t *ended;        // task whose transition is being measured
+    uint32_t ended_time;
+    profile_sample_t self;      // spent by the profiler
+} profile;
+
+static void profile_sample(profile_sample_t *s)
+{
+    s->time = profile_now() - profile.self.time;
+#ifdef LIBCHAIN_HOST
+    chain_host_nv_counts(&s->reads, &s->writes);
+    s->reads -= profile.self.reads;
+    s->writes -= profile.self.writes;
+#else // !LIBCHAIN_HOST
+    s->reads = s->writes = 0;
+#endif // !LIBCHAIN_HOST
+}
+
+/** @brief Leave out of all measurements what the profiler spent since the sample */
+static void profile_exclude(const profile_sample_t *s)
+{
+    profile_sample_t now;
+
+    profile_sample(&now);
+    profile.self.time += now.time - s->time;
+    profile.self.reads += now.reads - s->reads;
+    profile.self.writes += now.writes - s->writes;
+}
+
+static void profile_task_begin(const task_t *task)
+{
+    profile_sample_t s;
+
+    profile_sample(&s);
+    if (profile.ended) {
+        profile.ended->profile->total_overhead += s.time - profile.ended_time;
+        profile.ended = NULL;
+    }
+    ++task->profile->attempts;
+    profile.task_start = s;
+    profile_exclude(&s);
+}
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+/* The task starts over after a sleep, which is not part of the execution */
+static void profile_task_resume()
+{
+    profile_sample(&profile.task_start);
+}
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+static void profile_task_end(const task_t *task)
+{
+    chain_profile_task_t *p = task->profile;
+    profile_sample_t s;
+
+    profile_sample(&s);
+    uint32_t cycles = s.time - profile.task_start.time;
+    uint32_t reads = s.reads - profile.task_start.reads;
+    uint32_t writes = s.writes - profile.task_start.writes;
+
+    ++p->runs;
+    p->total_cycles += cycles;
+    p->total_nv_reads += reads;
+    p->total_nv_writes += writes;
+    if (cycles > p->max_cycles)
+        p->max_cycles = cycles;
+    if (reads > p->max_nv_reads)
+        p->max_nv_reads = reads;
+    if (writes > p->max_nv_writes)
+        p->max_nv_writes = writes;
+
+    profile.ended = task;
+    profile.ended_time = s.time;
+    profile_exclude(&s);
+}
+
+static void profile_site_begin()
+{
+    profile_sample(&profile.site_start);
+}
+
+/** @brief Account a call to chan_in or chan_out to its site
+ *  @details A site is added by filling in the entry before counting it.
+ */
+static void profile_site_end(void *addr, unsigned kind)
+{
+    chain_profile_site_t *site = chain_profile.sites;
+    chain_profile_site_t *end = site + chain_profile.num_sites;
+    profile_sample_t s;
+
+    profile_sample(&s);
+    uint32_t cycles = s.time - profile.site_start.time;
+
+    while (site < end && (site->addr != (uint32_t)(uintptr_t)addr || site->kind != kind))
+        ++site;
+
+    if (site == end) {
+        if (chain_profile.num_sites == LIBCHAIN_PROFILE_SITES) {
+            ++chain_profile.dropped;
+            profile_exclude(&s);
+            return;
+        }
+        memset(site, 0, sizeof(*site));
+        site->addr = (uint32_t)(uintptr_t)addr;
+        site->kind = kind;
+        ++chain_profile.num_sites;
+    }
+
+    ++site->calls;
+    site->total_cycles += cycles;
+    site->total_nv_reads += s.reads - profile.site_start.reads;
+    site->total_nv_writes += s.writes - profile.site_start.writes;
+    site->total_offset += profile.site_start.time - profile.task_start.time;
+    if (cycles > site->max_cycles)
+        site->max_cycles = cycles;
+
+    profile_exclude(&s);
+}
+
+static void profile_dump_bytes(const void *addr, size_t size)
+{
+    const uint8_t *bytes = addr;
+
+    printf("%lx ", (unsigned long)(uintptr_t)addr);
+    while (size--)
+        printf("%02x", *bytes++);
+    printf("\n");
+}
+
+void chain_profile_dump()
+{
+    const task_t *task;
+
+    profile_dump_bytes(&chain_profile, offsetof(chain_profile_t, sites) +
+                       chain_profile.num_sites * sizeof(chain_profile_site_t));
+    for (task = __start_chain_tasks; task < __stop_chain_tasks; ++task)
+        profile_dump_bytes(task->profile, sizeof(chain_profile_task_t));
+}
+
+#define PROFILE_TASK_BEGIN(task) profile_task_begin(task)
+#define PROFILE_TASK_RESUME() profile_task_resume()
+#define PROFILE_TASK_END(task) profile_task_end(task)
+#define PROFILE_SITE_BEGIN() profile_site_begin()
+#define PROFILE_SITE_END(kind) profile_site_end(__builtin_return_address(0), kind)
+#else // !LIBCHAIN_ENABLE_PROFILE
+#define PROFILE_TASK_BEGIN(task)
+#define PROFILE_TASK_RESUME()
+#define PROFILE_TASK_END(task)
+#define PROFILE_SITE_BEGIN()
+#define PROFILE_SITE_END(kind)
+#endif // !LIBCHAIN_ENABLE_PROFILE
+
+/** @brief Apply the writes in a redo log to the channel
+ *  @details Idempotent: the log is applied again from the beginning if the
+ *           application is interrupted, until the log is cleared.
+ */
+static void self_log_apply(const task_t *curtask, self_log_t *self_log)
+{
+    uint8_t *entry = self_log->data;
+    uint8_t *end = entry + self_log->used;
+    unsigned entries = 0;
+
+    while (entry < end) {
+        self_log_entry_t *hdr = (self_log_entry_t *)entry;
+        entry += sizeof(self_log_entry_t);
+
+        if (!hdr->var->timestamp)
+            chain_stamp_register(hdr->var);
+        memcpy(hdr->var, entry, hdr->var_size);
+        ++entries;
+        FAIL_POINT();
+
+        entry += SELF_LOG_ALIGN(hdr->var_size);
+    }
+    COUNT(curtask, swaps, entries);
+}
+
+/** @brief Apply the self-channel writes of the previous execution of a task
+ *  @details Called once per transition into the task, before it runs.
+ */
+static inline void task_commit_self(const task_t *curtask)
+{
+    // Minimize FRAM reads
+    self_field_meta_t **dirty_self_fields = curtask->dirty_self_fields;
+
+    int i;
+    unsigned swaps = 0;
+
+    // It is safe to repeat the loop for the same element, because the swap
+    // operation clears the dirty bit. We only need to be a little bit careful
+    // to decrement the count strictly after the swap.
+    //
+    // After the swap, the dirty bit is clear, which re-arms the field for
+    // being listed by the next chan_out to it.
+    while ((i = curtask->state->num_dirty_self_fields) > 0) {
+        self_field_meta_t *self_field = dirty_self_fields[--i];
+
+        if (self_field->idx_pair & SELF_CHAN_IDX_BIT_DIRTY_CURRENT) {
+            // Atomically: swap AND clear the dirty bit (by "moving" it over to MSB)
+            SWAP_IDX_PAIR(self_field);
+            ++swaps;
+        }
+        FAIL_POINT();
+
+        // Trade-off: either we do one FRAM write after each element, or
+        // we do only one write at the end (set to 0) but also not make
+        // forward progress if we reboot in the middle of this loop.
+        // We opt for making progress.
+        curtask->state->num_dirty_self_fields = i;
+        FAIL_POINT();
+    }
+    if (swaps)
+        COUNT(curtask, swaps, swaps);
+
+    self_log_t *self_log = curtask->self_log;
+    if (self_log && self_log->used) {
+        self_log_apply(curtask, self_log);
+        self_log->used = 0;
+        FAIL_POINT();
+    }
+}
+
+/** @brief Position of a FIFO end as seen by the task at the other end */
+static inline unsigned fifo_end_committed(fifo_end_t *end)
+{
+    return end->time != curctx->time ? end->staged : end->pos;
+}
+
+/** @brief Position of a FIFO end before an operation by its owner
+ *  @details The staged position is always the position as seen by the
+ *           owner. If it was staged by an earlier execution, which has
+ *           transitioned, it is first committed.
+ */
+static unsigned fifo_end_stage(fifo_end_t *end)
+{
+    if (end->time != curctx->time) {
+        end->pos = end->staged;
+        FAIL_POINT();
+        end->time = curctx->time;
+        FAIL_POINT();
+    }
+    return end->staged;
+}
+
+static inline unsigned fifo_distance(fifo_t *fifo, unsigned from, unsigned to)
+{
+    return to >= from ? to - from : to + 2 * fifo->capacity - from;
+}
+
+static inline unsigned fifo_advance(fifo_t *fifo, unsigned pos, unsigned n)
+{
+    pos += n;
+    return pos >= 2 * fifo->capacity ? pos - 2 * fifo->capacity : pos;
+}
+
+/** @brief Copy n elements between a buffer and the FIFO at a position */
+static void fifo_copy(fifo_t *fifo, unsigned pos, uint8_t *buf, unsigned n, int to_fifo)
+{
+    unsigned idx = pos >= fifo->capacity ? pos - fifo->capacity : pos;
+    unsigned first = fifo->capacity - idx; // elements before the wrap-around
+
+    if (first > n)
+        first = n;
+
+    uint8_t *elems = fifo->data + idx * fifo->elem_size;
+    size_t first_size = first * fifo->elem_size;
+    size_t rest_size = (n - first) * fifo->elem_size;
+
+    if (to_fifo) {
+        memcpy(elems, buf, first_size);
+        memcpy(fifo->data, buf + first_size, rest_size);
+    } else {
+        memcpy(buf, elems, first_size);
+        memcpy(buf + first_size, fifo->data, rest_size);
+    }
+}
+
+/** @brief Discard the operations of the incomplete execution of a task on FIFOs
+ *  @param  slot    slot of the checkpoint to roll back to, or -1 for none
+ */
+static void fifo_end_restart(fifo_end_t *end, int slot)
+{
+    if (end->time == curctx->time)
+        end->staged = slot >= 0 ? end->checkpoint[slot] : end->pos;
+}
+
+static void fifo_restart(const task_t *curtask, int slot)
+{
+    for (fifo_t * const *f = __start_chain_fifos; f < __stop_chain_fifos; ++f) {
+        if ((*f)->producer == curtask)
+            fifo_end_restart(&(*f)->tail, slot);
+        if ((*f)->consumer == curtask)
+            fifo_end_restart(&(*f)->head, slot);
+        FAIL_POINT();
+    }
+}
+
+/** @brief The latest checkpoint of the current execution of a task, if any */
+static checkpoint_slot_t *checkpoint_latest(const task_t *curtask)
+{
+    checkpoint_t *checkpoint = curtask->checkpoint;
+
+    if (!checkpoint)
+        return NULL;
+
+    checkpoint_slot_t *slot = &checkpoint->slots[checkpoint->slot];
+    return slot->time == curctx->time ? slot : NULL;
+}
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+#ifndef LIBCHAIN_HOST
+#define SLEEP_TIMER_REG_(n, reg) TA ## n ## reg
+#define SLEEP_TIMER_REG(reg) SLEEP_TIMER_REG_(LIBCHAIN_SLEEP_TIMER, reg)
+#define SLEEP_TIMER_VECTOR_(n) TIMER ## n ## _A0_VECTOR
+#define SLEEP_TIMER_VECTOR(n) SLEEP_TIMER_VECTOR_(n)
+
+/* ACLK is divided by 8, so that a period of the timer spans up to 16 s at 32 kHz */
+#define SLEEP_TIMER_TICKS(ms) ((uint32_t)(ms) * (LIBCHAIN_ACLK_HZ / 8) / 1000)
+
+#if SLEEP_TIMER_TICKS(LIBCHAIN_SLEEP_PERIOD_MS) > 0xffff
+#error LIBCHAIN_SLEEP_PERIOD_MS does not fit in the 16-bit sleep timer
+#endif
+
+static volatile unsigned sleep_timer_expired;
+
+__attribute__((interrupt(SLEEP_TIMER_VECTOR(LIBCHAIN_SLEEP_TIMER))))
+void chain_sleep_timer_isr()
+{
+    SLEEP_TIMER_REG(CTL) = MC__STOP;
+    sleep_timer_expired = 1;
+    __bic_SR_register_on_exit(LPM3_bits);
+}
+
+/** @brief Sleep in LPM3 for the given time (less than the timer range) */
+static void sleep_ms(uint32_t ms)
+{
+    sleep_timer_expired = 0;
+    SLEEP_TIMER_REG(CCR0) = SLEEP_TIMER_TICKS(ms);
+    SLEEP_TIMER_REG(CCTL0) = CCIE;
+    SLEEP_TIMER_REG(CTL) = TASSEL__ACLK | ID__8 | MC__UP | TACLR;
+
+    // Woken up by other interrupts too (e.g. ones that post events)
+    __disable_interrupt();
+    while (!sleep_timer_expired) {
+        __bis_SR_register(LPM3_bits | GIE);
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+}
+#else // LIBCHAIN_HOST
+#define sleep_ms(ms) chain_host_sleep(ms)
+#endif // LIBCHAIN_HOST
+
+uint32_t chain_clock()
+{
+    return clock_slots[clock_slot];
+}
+
+/** @brief Sleep until the persistent clock reaches the deadline */
+static void chain_sleep_until(uint32_t deadline)
+{
+    int32_t left;
+
+    while ((left = (int32_t)(deadline - chain_clock())) > 0) {
+        unsigned slot = clock_slot;
+        uint32_t ms = left < LIBCHAIN_SLEEP_PERIOD_MS ? left : LIBCHAIN_SLEEP_PERIOD_MS;
+
+        sleep_ms(ms);
+
+        clock_slots[slot ^ 1] = clock_slots[slot] + ms;
+        FAIL_POINT();
+        clock_slot = slot ^ 1;
+        FAIL_POINT();
+    }
+}
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+/** @brief Whether the current task is part of the handler of an event */
+static int event_handler_active()
+{
+    event_dispatch_t *d = &event_dispatch_state;
+    chain_time_t start = d->start;
+
+    // Distances from the start, so that the range may span a wraparound
+    return (chain_time_t)(chain_now - start) < (chain_time_t)(d->end - start);
+}
+
+static const task_t *event_handler(unsigned type)
+{
+    for (const event_handler_t *h = __start_chain_events; h < __stop_chain_events; ++h)
+        if (h->type == type)
+            return h->task;
+    return NULL;
+}
+
+/** @brief Redirect the transition to the given task to the handler of an event
+ *  @return The handler, or NULL if no event with a handler is queued
+ */
+static const task_t *event_dispatch(const task_t *next_task, chain_time_t next_time)
+{
+    // Cleared first, so that an event posted from here on sets it again
+    events_pending = 0;
+
+    for (unsigned level = 0; level < LIBCHAIN_EVENT_PRIORITIES; ++level) {
+        event_queue_t *queue = &event_queues[level];
+        unsigned head = queue->head;
+
+        while (head != queue->tail) {
+            chain_event_t *event = &queue->events[head % LIBCHAIN_EVENT_QUEUE_SIZE];
+            const task_t *handler = event_handler(event->type);
+
+            ++head;
+            if (!handler) {
+                queue->head = head;
+                FAIL_POINT();
+                continue;
+            }
+
+            event_dispatch_state.event = *event;
+            event_dispatch_state.resume = next_task;
+            event_dispatch_state.level = level;
+            event_dispatch_state.head = head;
+            // The current time: the one that precedes the start, 0 skipped
+            event_dispatch_state.end = chain_now;
+            FAIL_POINT();
+            event_dispatch_state.start = next_time;
+            FAIL_POINT();
+
+            // More events may be queued: look again after the handler
+            events_pending = 1;
+            return handler;
+        }
+    }
+    return NULL;
+}
+
+/** @brief Remove the event being handled from its queue
+ *  @details Idempotent, so it is repeated on boot in case power failed
+ *           between the transition into the handler and the removal.
+ */
+static void event_dequeue()
+{
+    event_dispatch_t *d = &event_dispatch_state;
+
+    event_queues[d->level].head = d->head;
+}
+
+/** @brief Restore the staged values that the writes made after a checkpoint replaced
+ *  @details Each field is saved at most once per checkpoint, so the order
+ *           does not matter, and restoring an entry again is harmless.
+ */
+static void checkpoint_undo(checkpoint_t *checkpoint, checkpoint_slot_t *slot)
+{
+    uint8_t *entry = checkpoint->undo;
+    uint8_t *end = entry + slot->undo_used;
+
+    if (entry == end)
+        return;
+
+    while (entry < end) {
+        checkpoint_undo_entry_t *hdr = (checkpoint_undo_entry_t *)entry;
+        entry += sizeof(checkpoint_undo_entry_t);
+
+        memcpy(hdr->var, entry, hdr->var_size);
+        FAIL_POINT();
+        hdr->self_field->idx_pair |= SELF_CHAN_IDX_BIT_CHECKPOINT_CURRENT;
+        FAIL_POINT();
+
+        entry += SELF_LOG_ALIGN(hdr->var_size);
+    }
+    slot->undo_used = 0;
+    FAIL_POINT();
+}
+
+/** @brief Discard the writes of the incomplete execution of a task
+ *  @param checkpoint   checkpoint to keep the writes made before, or NULL
+ *  @details The fields listed by the incomplete execution must be unmarked,
+ *           because a field is listed only if it is not yet marked dirty.
+ */
+static void task_discard(const task_t *curtask, checkpoint_slot_t *checkpoint)
+{
+    self_field_meta_t **dirty_self_fields = curtask->dirty_self_fields;
+    int keep = checkpoint ? checkpoint->num_dirty_self_fields : 0;
+    int i;
+
+    fifo_restart(curtask, checkpoint ? (int)curtask->checkpoint->slot : -1);
+
+    while ((i = curtask->state->num_dirty_self_fields) > keep) {
+        dirty_self_fields[--i]->idx_pair &= ~(SELF_CHAN_IDX_BIT_DIRTY_CURRENT |
+                                              SELF_CHAN_IDX_BIT_CHECKPOINT_CURRENT);
+        FAIL_POINT();
+        curtask->state->num_dirty_self_fields = i;
+        FAIL_POINT();
+    }
+
+    if (checkpoint)
+        checkpoint_undo(curtask->checkpoint, checkpoint);
+
+    if (curtask->self_log)
+        curtask->self_log->used = checkpoint ? checkpoint->self_log_used : 0;
+}
+
+/**
+ * @brief Function to be invoked at the beginning of every task
+ */
+void task_prologue()
+{
+    const task_t *curtask = chain_task;
+
+    // Swaps of the self-channel buffer happen on transitions, not restarts.
+    // The transition flags the context until the swaps are done.
+    if (curctx->task & CONTEXT_PROLOGUE) {
+        task_commit_self(curtask);
+        curctx->task &= ~CONTEXT_PROLOGUE;
+        FAIL_POINT();
+    } else {
+        // In this case, swapping that needed to take place after the last
+        // transition has run to completion (even if it was restarted)
+        // [because the flag was cleared]. We get into this clause only
+        // because of a restart. We must clear any state that the incomplete
+        // execution of the task might have changed.
+        //
+        // If the execution took a checkpoint, it resumes from there, so only
+        // the writes made after the checkpoint are discarded.
+        task_discard(curtask, checkpoint_latest(curtask));
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+        // A TRANSITION_AFTER that did not commit: the next execution
+        // waits only if the re-execution defers its transition again
+        if (chain_wait.time == time_next(curctx->time))
+            chain_wait.deadline = chain_clock();
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+        // An EVENT_RETURN that did not commit: the handler is still running
+        if (event_dispatch_state.end == time_next(curctx->time))
+            event_dispatch_state.end = time_prev(event_dispatch_state.start);
+
+        // The batch was too large to complete on the energy at hand
+        if (curtask->state->batch > 1)
+            curtask->state->batch >>= 1;
+
+        COUNT(curtask, restarts, 1);
+        TRACE(CHAIN_TRACE_RESTART, curtask, NULL, 0);
+    }
+
+    PROFILE_TASK_BEGIN(curtask);
+}
+
+/** @brief Forget a logical time that is older than the horizon
+ *  @details Logical times that are compared for equality with the current
+ *           one are set to 0, which is never current, before they can
+ *           wrap around to it.
+ */
+static inline void time_expire(volatile chain_time_t *time, chain_time_t now)
+{
+    if (*time && (chain_time_t)(now - *time) >= CHAIN_TIME_HORIZON) {
+        *time = 0;
+        FAIL_POINT();
+    }
+}
+
+/** @brief Expire the logical times kept by the runtime, outside of channels
+ *  @details Also applies the redo logs that wait for the next execution of
+ *           their task, which may be far off: the logged timestamps then
+ *           reach the variables, and so the sweep, within a pass of their
+ *           write. The log of the current execution is not committed yet.
+ */
+static void time_sweep_runtime(chain_time_t now)
+{
+    for (const task_t *task = __start_chain_tasks; task < __stop_chain_tasks; ++task) {
+        if (task->checkpoint) {
+            time_expire(&task->checkpoint->slots[0].time, now);
+            time_expire(&task->checkpoint->slots[1].time, now);
+        }
+
+        self_log_t *self_log = task->self_log;
+        if (self_log && self_log->used && task != chain_task) {
+            self_log_apply(task, self_log);
+            self_log->used = 0;
+            FAIL_POINT();
+        }
+    }
+
+    for (fifo_t * const *f = __start_chain_fifos; f < __stop_chain_fifos; ++f) {
+        time_expire(&(*f)->head.time, now);
+        time_expire(&(*f)->tail.time, now);
+    }
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+    time_expire(&chain_wait.time, now);
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+    // A handler that ended long ago: empty the range, before the time wraps
+    // around into it. One that runs (end before start) is left as is.
+    event_dispatch_t *d = &event_dispatch_state;
+    if (time_next(d->end) != d->start &&
+        (chain_time_t)(now - d->end) >= CHAIN_TIME_HORIZON) {
+        d->start = d->end;
+        FAIL_POINT();
+    }
+}
+
+/** @brief One step of the sweep of the timestamps (see LIBCHAIN_STAMPS)
+ *  @param now  logical time of the transition being committed
+ *  @details Runs before the transition commits, so a step interrupted by a
+ *           power failure is repeated by the re-execution. Every action is
+ *           idempotent.
+ */
+static void time_sweep(chain_time_t now, uint32_t now_era)
+{
+    unsigned next = stamp_table.next;
+
+    if (next < stamp_table.count) {
+        stamp_t *stamp = &stamp_table.stamps[next];
+        var_meta_t *var = stamp->var;
+        chain_time_t age = now - var->timestamp;
+
+        if (age < CHAIN_TIME_HORIZON) {
+            // Written since the previous visit, or not: the time is exact
+            uint64_t time = FULL_TIME(now_era, now) - age;
+            if (stamp->time != time) {
+                stamp->time = time;
+                FAIL_POINT();
+            }
+        } else {
+            // Older than the horizon, so the time is recorded: keep the age
+            // past the horizon (also at the current, preceding, time) and
+            // away from a wraparound, which it would reach before the next
+            // visit otherwise
+            chain_time_t timestamp = now - CHAIN_TIME_HORIZON - 1;
+            var->timestamp = timestamp ? timestamp : (chain_time_t)-1;
+            FAIL_POINT();
+        }
+        ++next;
+    } else {
+        time_sweep_runtime(now);
+        next = 0;
+    }
+
+    stamp_table.next = next;
+    FAIL_POINT();
+}
+
+void transition_commit(const task_t *next_task) __attribute__((noreturn, used));
+
+/**
+ * @brief Transfer control to the given task
+ * @details Finalize the current task and jump to the given task.
+ *          This function does not return.
+ *
+ *          On MSP430, this function is bare: it resets the stack pointer to
+ *          the top of the stack (provided by the linker script), without
+ *          saving anything on the stack that is being discarded, and
+ *          branches to the commit, with the argument register intact.
+ */
+#ifdef LIBCHAIN_HOST
+void transition_to(const task_t *next_task)
+{
+    transition_commit(next_task);
+}
+#else // !LIBCHAIN_HOST
+__attribute__((naked)) void transition_to(const task_t *next_task)
+{
+    __asm__ volatile (
+        "mov #__stack, r1\n"
+        "br #transition_commit\n"
+    );
+}
+#endif // !LIBCHAIN_HOST
+
+/**
+ * @brief Commit the transition to the given task and jump to it
+ * @details The prologue of the next task is fused into the transition: the
+ *          context is known to be a new one, so the prologue does not need
+ *          to re-read it from FRAM to find out whether this is a restart.
+ */
+void transition_commit(const task_t *next_task)
+{
+    PROFILE_TASK_END(chain_task);
+
+    // The writes staged in the cache become the task's writes to channels
+    CACHE_WRITE_BACK();
+    CACHE_RESET();
+
+    chain_time_t next_time = time_next(chain_now);
+    uint32_t next_era = era + (next_time < chain_now);
+    context_t *next_ctx = curctx == &contexts[0] ? &contexts[1] : &contexts[0];
+
+    // update current task pointer
+    // tick logical time
+    // jump to next task
+
+    // NOTE: the order of these does not seem to matter, a reboot
+    // at any point in this sequence seems to be harmless.
+    //
+    // NOTE: It is harmless to increment the time even if we fail before
+    // transitioning to the next task. The reverse, i.e. failure to increment
+    // time while having transitioned to the task, would break the
+    // semantics of CHAN_IN (aka. sync), which should get the most recently
+    // updated value.
+    //
+    // NOTE: The time is written last, because writing it is what makes the
+    // slot current: until then, the slot holds a stale context with a time
+    // two less than the current one. So, the pointer to the current slot
+    // lives in SRAM, and the transition costs two FRAM writes: the task word
+    // and the time of the slot. The call depth is written only by the two
+    // transitions that follow a change of it, and the era only in the first
+    // two times of an era. A next task with self-channel writes to apply
+    // costs one more, to clear the flag of its prologue.
+
+    // NOTE: The logical time wraps around. The timestamps in channels are
+    // kept comparable by a sweep, of which one step runs before the commit
+    // of every LIBCHAIN_STAMP_SWEEP_INTERVAL-th logical time.
+
+    if (!(next_time & (LIBCHAIN_STAMP_SWEEP_INTERVAL - 1)))
+        time_sweep(next_time, next_era);
+
+    FAIL_POINT();
+
+    const task_t *handler = NULL;
+    if (events_pending && !wait_requested && !event_handler_active())
+        handler = event_dispatch(next_task, next_time);
+    if (handler)
+        next_task = handler;
+
+    // The prologue of the next task is flagged only if it has writes to
+    // apply: otherwise, a reboot before the task starts is a restart of it,
+    // which discards nothing
+    self_log_t *next_log = next_task->self_log;
+    unsigned prologue = (next_task->state->num_dirty_self_fields ||
+                         (next_log && next_log->used)) ? CONTEXT_PROLOGUE : 0;
+    task_idx_t next_word = (task_idx_t)(next_task - __start_chain_tasks);
+    unsigned slot = next_ctx - contexts;
+
+    next_ctx->task = next_word | prologue;
+    if (context_call_depth[slot] != call_depth) {
+        next_ctx->call_depth = call_depth;
+        context_call_depth[slot] = call_depth;
+    }
+    // The era changes on wraparound, and reaches both slots by the second
+    // time of the new era
+    if (next_time <= 2)
+        next_ctx->era = next_era;
+    FAIL_POINT();
+    next_ctx->time = next_time;
+    // Counted right after the commit, so that a restart cannot count it twice
+    COUNT(chain_task, executions, 1);
+    FAIL_POINT();
+
+    // The batch completed: try a larger one in the next execution
+    if (batch_running) {
+        task_state_t *state = chain_task->state;
+        if (state->batch < LIBCHAIN_BATCH_MAX)
+            ++state->batch;
+        batch_running = 0;
+    }
+
+    curctx = next_ctx;
+    chain_task = next_task;
+    chain_now = next_time;
+    era = next_era;
+
+    if (handler) {
+        event_dequeue();
+        FAIL_POINT();
+    }
+
+    TRACE(CHAIN_TRACE_TRANSITION, next_task, NULL, 0);
+
+    // Prologue of the next task: after a transition, it is never a restart.
+    // If power fails before the flag is cleared, the prologue runs on reboot.
+    if (prologue) {
+        task_commit_self(next_task);
+        next_ctx->task = next_word;
+        FAIL_POINT();
+    }
+
+    PROFILE_TASK_BEGIN(next_task);
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+    if (wait_requested) {
+        wait_requested = 0;
+        chain_sleep_until(chain_wait.deadline);
+        PROFILE_TASK_RESUME();
+    }
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+#ifdef LIBCHAIN_HOST
+    chain_host_transition(next_task);
+#else // !LIBCHAIN_HOST
+    __asm__ volatile ( // volatile because output operands unused by C
+        "br %[ntask]\n"
+        :
+        : [ntask] "r" (next_task->func)
+    );
+    __builtin_unreachable();
+#endif // !LIBCHAIN_HOST
+}
+
+void transition_call(const task_t *callee, const task_t *ret)
+{
+    if (call_depth == LIBCHAIN_CALL_DEPTH)
+        LIBCHAIN_FATAL("call stack overflow");
+
+    call_stack[call_depth] = ret;
+    FAIL_POINT();
+    ++call_depth;
+
+    transition_to(callee);
+}
+
+void transition_return()
+{
+    if (!call_depth)
+        LIBCHAIN_FATAL("return without a call");
+
+    --call_depth;
+    transition_to(call_stack[call_depth]);
+}
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+/**
+ * @brief Transfer control to the given task after a delay
+ * @details The deadline is recorded for the next logical time before the
+ *          transition commits it, so that a reboot after the commit resumes
+ *          the sleep (see chain_boot).
+ */
+void transition_after(const task_t *next_task, uint32_t delay_ms)
+{
+    chain_wait.deadline = chain_clock() + delay_ms;
+    FAIL_POINT();
+    chain_wait.time = time_next(chain_now);
+    FAIL_POINT();
+
+    wait_requested = 1;
+    transition_to(next_task);
+}
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+/** @brief Locate the variable that holds the current value of a field in a channel
+ *  @details For self-channels, this is the current buffer of the field.
+ */
+static var_meta_t *chan_in_var(uint8_t *chan, size_t field_offset, size_t var_size)
+{
+    uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
+    chan_meta_t *chan_meta = (chan_meta_t *)(chan +
+                                offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
+    uint8_t *field = chan_data + field_offset;
+
+    switch (chan_meta->type) {
+        case CHAN_TYPE_SELF: {
+            self_field_meta_t *self_field = (self_field_meta_t *)field;
+
+            unsigned var_offset =
+                (self_field->idx_pair & SELF_CHAN_IDX_BIT_CURRENT) ? var_size : 0;
+
+            return (var_meta_t *)(field +
+                    offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
+        }
+        case CHAN_TYPE_VOLATILE:
+            if (VOLATILE_CHAN_META(chan)->epoch != boot_epoch)
+                return NULL; // written before the last reboot
+            // fall-through
+        default:
+            return (var_meta_t *)(field +
+                    offsetof(FIELD_TYPE(void_type_t), var));
+    }
+}
+
+/** @brief Regenerate the contents of a stale volatile channel
+ *  @details The execution of the current task is discarded, as on a
+ *           restart, and the task runs again after the call returns.
+ */
+static void chan_regenerate(uint8_t *chan)
+{
+    const task_t *curtask = chain_task;
+
+    CACHE_RESET();
+    task_discard(curtask, checkpoint_latest(curtask));
+    batch_running = 0;
+
+    TRACE(CHAIN_TRACE_RESTART, curtask, NULL, 0);
+
+    transition_call(VOLATILE_CHAN_META(chan)->regen, curtask);
+}
+
+#ifdef LIBCHAIN_ENABLE_CACHE
+typedef enum {
+    CACHE_FREE,
+    CACHE_READ,     // result of a CHAN_IN
+    CACHE_WRITE,    // value to write into a field of a channel on transition
+} cache_kind_t;
+
+/** @brief Field cached in SRAM for the duration of a task execution
+ *  @details A read is identified by its list of channels, since which one
+ *           holds the latest value does not change within the execution,
+ *           except by the writes of the task itself. Those are staged in
+ *           write entries, which reads see only for channels other than
+ *           self-channels, as when the writes go to the channels directly.
+ */
+typedef struct {
+    cache_kind_t kind;
+    int visible;                // write that reads see
+    unsigned count;             // of channels
+    uint8_t *chans[LIBCHAIN_CACHE_MAX_CHANS];
+    size_t field_offsets[LIBCHAIN_CACHE_MAX_CHANS];
+    size_t var_size;
+    const char *field_name;     // of a write, for diagnostics
+    uint8_t *value;
+} cache_entry_t;
+
+static cache_entry_t cache_entries[LIBCHAIN_CACHE_ENTRIES];
+static unsigned cache_num_entries;
+static unsigned cache_visible_writes; // number of write entries that reads see
+
+/* Values are allocated until the end of the execution, so that the pointers
+ * returned by chan_in remain valid even if their entries are dropped */
+static uint8_t cache_data[LIBCHAIN_CACHE_SIZE] __attribute__((aligned(sizeof(var_meta_t))));
+static unsigned cache_data_used;
+
+static cache_entry_t *cache_alloc(cache_kind_t kind, size_t var_size)
+{
+    size_t size = SELF_LOG_ALIGN(var_size - sizeof(var_meta_t));
+    cache_entry_t *entry = NULL;
+    unsigned i;
+
+    if (cache_data_used + size > LIBCHAIN_CACHE_SIZE)
+        return NULL;
+
+    for (i = 0; i < cache_num_entries && !entry; ++i)
+        if (cache_entries[i].kind == CACHE_FREE)
+            entry = &cache_entries[i];
+    if (!entry) {
+        if (cache_num_entries == LIBCHAIN_CACHE_ENTRIES)
+            return NULL;
+        entry = &cache_entries[cache_num_entries++];
+    }
+
+    entry->kind = kind;
+    entry->var_size = var_size;
+    entry->value = cache_data + cache_data_used;
+    cache_data_used += size;
+    return entry;
+}
+
+static cache_entry_t *cache_find_write(uint8_t *chan, size_t field_offset)
+{
+    for (unsigned i = 0; i < cache_num_entries; ++i) {
+        cache_entry_t *entry = &cache_entries[i];
+        if (entry->kind == CACHE_WRITE && entry->chans[0] == chan &&
+            entry->field_offsets[0] == field_offset)
+            return entry;
+    }
+    return NULL;
+}
+
+/** @brief Drop the reads whose result a write into the channel may change */
+static void cache_invalidate_reads(uint8_t *chan)
+{
+    for (unsigned i = 0; i < cache_num_entries; ++i) {
+        cache_entry_t *entry = &cache_entries[i];
+        if (entry->kind != CACHE_READ)
+            continue;
+        for (unsigned j = 0; j < entry->count; ++j)
+            if (entry->chans[j] == chan)
+                entry->kind = CACHE_FREE;
+    }
+}
+
+/** @brief Look up a read in the cache
+ *  @return Pointer to the value in the cache, or NULL on a miss
+ */
+static void *cache_in(size_t var_size, int count, va_list ap)
+{
+    uint8_t *chans[LIBCHAIN_CACHE_MAX_CHANS];
+    size_t field_offsets[LIBCHAIN_CACHE_MAX_CHANS];
+    int i;
+
+    if (count > LIBCHAIN_CACHE_MAX_CHANS && !cache_visible_writes)
+        return NULL;
+
+    for (i = 0; i < count; ++i) {
+        uint8_t *chan = va_arg(ap, uint8_t *);
+        size_t field_offset = va_arg(ap, size_t);
+
+        // Written in this execution, so the latest
+        if (cache_visible_writes) {
+            cache_entry_t *entry = cache_find_write(chan, field_offset);
+            if (entry && entry->visible)
+                return entry->value;
+        }
+
+        if (i < LIBCHAIN_CACHE_MAX_CHANS) {
+            chans[i] = chan;
+            field_offsets[i] = field_offset;
+        }
+    }
+
+    if (count > LIBCHAIN_CACHE_MAX_CHANS)
+        return NULL;
+
+    for (unsigned e = 0; e < cache_num_entries; ++e) {
+        cache_entry_t *entry = &cache_entries[e];
+
+        if (entry->kind != CACHE_READ || entry->count != count ||
+            entry->var_size != var_size)
+            continue;
+        for (i = 0; i < count; ++i)
+            if (entry->chans[i] != chans[i] || entry->field_offsets[i] != field_offsets[i])
+                break;
+        if (i == count)
+            return entry->value;
+    }
+    return NULL;
+}
+
+/** @brief Remember the result of a read
+ *  @return Pointer to the copy of the value in the cache, or to the value in
+ *          the channel if the cache is full
+ */
+static void *cache_fill(void *value, size_t var_size, int count, va_list ap)
+{
+    cache_entry_t *entry;
+    int i;
+
+    if (count > LIBCHAIN_CACHE_MAX_CHANS || !(entry = cache_alloc(CACHE_READ, var_size)))
+        return value;
+
+    entry->count = count;
+    for (i = 0; i < count; ++i) {
+        entry->chans[i] = va_arg(ap, uint8_t *);
+        entry->field_offsets[i] = va_arg(ap, size_t);
+    }
+    memcpy(entry->value, value, var_size - sizeof(var_meta_t));
+    return entry->value;
+}
+
+/** @brief Stage a write in the cache
+ *  @return Whether the write was staged, or else has to go to the channel
+ */
+static int cache_out(const char *field_name, const void *value, size_t var_size,
+                     uint8_t *chan, size_t field_offset)
+{
+    cache_entry_t *entry = cache_find_write(chan, field_offset);
+
+    if (!entry) {
+        chan_meta_t *chan_meta = (chan_meta_t *)(chan +
+                                    offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
+        int visible = chan_meta->type != CHAN_TYPE_SELF &&
+                      chan_meta->type != CHAN_TYPE_SELF_LOG;
+
+        if (visible)
+            cache_invalidate_reads(chan);
+        if (!(entry = cache_alloc(CACHE_WRITE, var_size)))
+            return 0;
+
+        entry->visible = visible;
+        cache_visible_writes += visible;
+        entry->count = 1;
+        entry->chans[0] = chan;
+        entry->field_offsets[0] = field_offset;
+        entry->field_name = field_name;
+    }
+
+    memcpy(entry->value, value, var_size - sizeof(var_meta_t));
+    return 1;
+}
+
+static var_meta_t *chan_out_one(const char *field_name, const void *value,
+                                size_t var_size, uint8_t *chan, size_t field_offset);
+
+/** @brief Write the staged writes into the channels and drop all entries
+ *  @details Called on transition, and before any access that bypasses the
+ *           cache, so that the channels hold what the task wrote. The values
+ *           stay allocated until the end of the execution.
+ */
+static void cache_write_back()
+{
+    for (unsigned i = 0; i < cache_num_entries; ++i) {
+        cache_entry_t *entry = &cache_entries[i];
+        if (entry->kind == CACHE_WRITE)
+            chan_out_one(entry->field_name, entry->value, entry->var_size,
+                         entry->chans[0], entry->field_offsets[0]);
+    }
+    cache_num_entries = 0;
+    cache_visible_writes = 0;
+}
+
+/** @brief Drop the cache, without writing back: on transition and restart */
+static void cache_reset()
+{
+    cache_num_entries = 0;
+    cache_visible_writes = 0;
+    cache_data_used = 0;
+}
+#endif // LIBCHAIN_ENABLE_CACHE
+
+void chain_stamp_register(var_meta_t *var)
+{
+    unsigned n = stamp_table.count;
+
+    // Registered, but power failed before the variable was stamped
+    if (n && stamp_table.stamps[n - 1].var == var)
+        return;
+
+    if (n == LIBCHAIN_STAMPS)
+        LIBCHAIN_FATAL("timestamp table overflow: raise LIBCHAIN_STAMPS");
+
+    // The time is recorded by the sweep before it is needed
+    stamp_table.stamps[n].var = var;
+    FAIL_POINT();
+    stamp_table.count = n + 1;
+    FAIL_POINT();
+}
+
+/** @brief Full logical time of the latest write of a variable older than the horizon
+ *  @return 0 if the variable was never written
+ */
+static uint64_t stamp_time(const var_meta_t *var)
+{
+    unsigned count = stamp_table.count;
+
+    if (var && var->timestamp) {
+        for (unsigned i = 0; i < count; ++i)
+            if (stamp_table.stamps[i].var == var)
+                return stamp_table.stamps[i].time;
+    }
+    return 0;
+}
+
+int chain_stamp_newer_slow(const var_meta_t *var, const var_meta_t *than)
+{
+    return stamp_time(var) > stamp_time(than);
+}
+
+/** @brief Sync: return the most recently updated value of a given field
+ *  @param field_name   string name of the field, used for diagnostics
+ *  @param var_size     size of the 'variable' type (var_meta_t + value type)
+ *  @param count        number of channels to sync
+ *  @param ...          channel ptr, field offset in corresponding message type
+ *  @return Pointer to the value, ready to be cast to final value type pointer
+ */
+void *chan_in(const char *field_name, size_t var_size, int count, ...)
+{
+    va_list ap;
+    unsigned i;
+    chain_time_t latest_age = CHAIN_TIME_NEVER;
+#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
+    unsigned latest_chan_idx = 0;
+#endif
+#ifdef LIBCHAIN_ENABLE_TRACE
+    uint8_t *latest_chan = NULL;
+    size_t latest_field_offset = 0;
+#endif
+
+    var_meta_t *var;
+    var_meta_t *latest_var = NULL;
+    uint8_t *stale_chan = NULL;
+
+    PROFILE_SITE_BEGIN();
+
+    LIBCHAIN_PRINTF("[%u] %s: in: '%s':", curctx->time,
+                    chain_task->name, field_name);
+
+    FAIL_POINT();
+
+    va_start(ap, count);
+
+#ifdef LIBCHAIN_ENABLE_CACHE
+    va_list aq;
+    va_copy(aq, ap);
+    void *cached = cache_in(var_size, count, aq);
+    va_end(aq);
+    if (cached) {
+        va_end(ap);
+        LIBCHAIN_PRINTF(" cached\r\n");
+        PROFILE_SITE_END(0);
+        return cached;
+    }
+    va_copy(aq, ap);
+#endif // LIBCHAIN_ENABLE_CACHE
+
+    for (i = 0; i < count; ++i) {
+        uint8_t *chan = va_arg(ap, uint8_t *);
+        size_t field_offset = va_arg(ap, size_t);
+
+        var = chan_in_var(chan, field_offset, var_size);
+        if (!var) {
+            stale_chan = chan;
+            continue;
+        }
+
+#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
+        chan_meta_t *chan_meta = (chan_meta_t *)(chan +
+                                    offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
+        LIBCHAIN_PRINTF(" {%u} %s->%s c%04x:off%u:v%04x [%u],", i,
+               chan_meta->diag.source_name, chan_meta->diag.dest_name,
+               (uint16_t)(uintptr_t)chan, (unsigned)field_offset,
+               (uint16_t)(uintptr_t)var, var->timestamp);
+#endif
+
+        chain_time_t age = chain_stamp_age(var->timestamp);
+        if (chain_stamp_newer(var, age, latest_var, latest_age)) {
+            latest_age = age;
+            latest_var = var;
+#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
+            latest_chan_idx = i;
+#endif
+#ifdef LIBCHAIN_ENABLE_TRACE
+            latest_chan = chan;
+            latest_field_offset = field_offset;
+#endif
+        }
+    }
+    va_end(ap);
+
+    // No fallback holds the value either: recompute it
+    if (!latest_var && stale_chan && VOLATILE_CHAN_META(stale_chan)->regen) {
+#ifdef LIBCHAIN_ENABLE_CACHE
+        va_end(aq);
+#endif // LIBCHAIN_ENABLE_CACHE
+        chan_regenerate(stale_chan);
+    }
+
+    TRACE(CHAIN_TRACE_IN, chain_task, latest_chan, latest_field_offset);
+
+    LIBCHAIN_PRINTF(": {latest %u}: ", latest_chan_idx);
+
+    uint8_t *value = (uint8_t *)latest_var + offsetof(VAR_TYPE(void_type_t), value);
+
+#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
+    for (int i = 0; i < var_size - sizeof(var_meta_t); ++i)
+        LIBCHAIN_PRINTF("%02x ", value[i]);
+    LIBCHAIN_PRINTF("\r\n");
+#endif
+
+    // NOTE: No two timestamps compared above can be equal, except those
+    // older than the horizon, which are ordered by the slow path.
+    // ASSERT(latest_field != NULL);
+
+#ifdef LIBCHAIN_ENABLE_CACHE
+    if (latest_var)
+        value = cache_fill(value, var_size, count, aq);
+    va_end(aq);
+#endif // LIBCHAIN_ENABLE_CACHE
+
+    PROFILE_SITE_END(0);
+    return (void *)value;
+}
+
+/** @brief Locate the variable that a write to a field in a channel goes to
+ *  @param enqueue  for self-channels, whether to enqueue the field for swap
+ *  @details For self-channels, this is the staging buffer of the field. For
+ *           redo-log self-channels, this is a new entry in the log.
+ */
+static var_meta_t *chan_out_var(uint8_t *chan, size_t field_offset,
+                                size_t var_size, int enqueue)
+{
+    var_meta_t *var;
+
+    uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
+    chan_meta_t *chan_meta = (chan_meta_t *)(chan +
+                                offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
+    uint8_t *field = chan_data + field_offset;
+
+    switch (chan_meta->type) {
+        case CHAN_TYPE_SELF: {
+            self_field_meta_t *self_field = (self_field_meta_t *)field;
+            unsigned idx_pair = self_field->idx_pair;
+
+            unsigned var_offset = (idx_pair & SELF_CHAN_IDX_BIT_NEXT) ? var_size : 0;
+
+            var = (var_meta_t *)(field +
+                    offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
+
+            chain_self_out(self_field, idx_pair, var, var_size, enqueue);
+            break;
+        }
+        case CHAN_TYPE_SELF_LOG: {
+            self_log_t *self_log = chain_task->self_log;
+            unsigned used = self_log->used;
+            unsigned entry_size = sizeof(self_log_entry_t) + SELF_LOG_ALIGN(var_size);
+
+            if (used + entry_size > self_log->size)
+                LIBCHAIN_FATAL("redo log overflow");
+
+            // The entry is visible to the prologue only after a transition,
+            // by which time its contents are complete.
+            self_log_entry_t *hdr = (self_log_entry_t *)(self_log->data + used);
+            hdr->var = (var_meta_t *)(field + offsetof(FIELD_TYPE(void_type_t), var));
+            hdr->var_size = var_size;
+            self_log->used = used + entry_size;
+            FAIL_POINT();
+
+            // Not in the table of timestamps: the log is applied to the
+            // field, stamp included, by the next transition into the task,
+            // or by the sweep if that comes first (see time_sweep_runtime)
+            var = (var_meta_t *)(hdr + 1);
+            var->timestamp = chain_now;
+            break;
+        }
+        case CHAN_TYPE_VOLATILE:
+            VOLATILE_CHAN_META(chan)->epoch = boot_epoch;
+            // fall-through
+        default:
+            var = (var_meta_t *)(field +
+                    offsetof(FIELD_TYPE(void_type_t), var));
+    }
+
+    return var;
+}
+
+/** @brief Write a value to a field in one channel
+ *  @return Pointer to the variable that was written
+ */
+static var_meta_t *chan_out_one(const char *field_name, const void *value,
+                                size_t var_size, uint8_t *chan, size_t field_offset)
+{
+    var_meta_t *var = chan_out_var(chan, field_offset, var_size, 1);
+
+#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
+    chan_meta_t *chan_meta = (chan_meta_t *)(chan +
+                                offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
+
+    LIBCHAIN_PRINTF("[%u] %s: out: '%s': %s -> %s c%04x:off%u:v%04x: ",
+           curctx->time, chain_task->name, field_name,
+           chan_meta->diag.source_name, chan_meta->diag.dest_name,
+           (uint16_t)(uintptr_t)chan, (unsigned)field_offset, (uint16_t)(uintptr_t)var);
+
+    for (int i = 0; i < var_size - sizeof(var_meta_t); ++i)
+        LIBCHAIN_PRINTF("%02x ", *((uint8_t *)value + i));
+    LIBCHAIN_PRINTF("\r\n");
+#endif
+
+    chain_stamp(var);
+    FAIL_POINT();
+    void *var_value = (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
+    memcpy(var_value, value, var_size - sizeof(var_meta_t));
+    COUNT(chain_task, bytes_written, var_size - sizeof(var_meta_t));
+    TRACE(CHAIN_TRACE_OUT, chain_task, chan, field_offset);
+
+    return var;
+}
+
+/** @brief Begin an in-place write of a field in a channel
+ *  @param var_size      size of the 'variable' type (var_meta_t + value type)
+ *  @param chan          channel ptr
+ *  @param field_offset  field offset in the message type of the channel
+ *  @return Pointer to the value in the channel (for self-channels, the value
+ *          in the staging buffer), to be filled in by the task
+ *  @details For a redo-log self-channel, the write takes effect even if it is
+ *           not committed, because it is appended to the log here.
+ */
+void *chan_out_begin(size_t var_size, void *chan, size_t field_offset)
+{
+    CACHE_WRITE_BACK();
+    var_meta_t *var = chan_out_var((uint8_t *)chan, field_offset, var_size, 0);
+    return (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
+}
+
+/** @brief Commit an in-place write of a field in a channel
+ *  @param field_name    string name of the field, used for diagnostics
+ *  @param var_size      size of the 'variable' type (var_meta_t + value type)
+ *  @param chan          channel ptr
+ *  @param field_offset  field offset in the message type of the channel
+ *  @details Stamping the value, and for self-channels enqueuing the swap,
+ *           is what publishes the value, just like in chan_out.
+ */
+void chan_out_commit(const char *field_name, size_t var_size,
+                     void *chan, size_t field_offset)
+{
+    chan_meta_t *chan_meta = (chan_meta_t *)((uint8_t *)chan +
+                                offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
+
+    // The log entry was stamped when it was appended
+    if (chan_meta->type == CHAN_TYPE_SELF_LOG)
+        return;
 
-/* To update the context, fill-in the unused one and flip the pointer to it */
-__nv context_t context_1 = {0};
-__nv context_t context_0 = {
-    .task = TASK_REF(_entry_task),
-    .time = 0,
-    .next_ctx = &context_1,
-};
+    var_meta_t *var = chan_out_var((uint8_t *)chan, field_offset, var_size, 1);
 
-__nv context_t * volatile curctx = &context_0;
+    LIBCHAIN_PRINTF("[%u] %s: out: '%s': commit v%04x\r\n", curctx->time,
+                    chain_task->name, field_name, (uint16_t)(uintptr_t)var);
 
-// for internal instrumentation purposes
-__nv volatile unsigned _numBoots = 0;
+    chain_stamp(var);
+    FAIL_POINT();
+    COUNT(chain_task, bytes_written, var_size - sizeof(var_meta_t));
+    TRACE(CHAIN_TRACE_OUT, chain_task, chan, field_offset);
+}
 
-/**
- * @brief Function to be invoked at the beginning of every task
+/** @brief Write a value to a field in a channel
+ *  @param field_name    string name of the field, used for diagnostics
+ *  @param value         pointer to value data
+ *  @param var_size      size of the 'variable' type (var_meta_t + value type)
+ *  @param count         number of output channels
+ *  @param ...           channel ptr, field offset in corresponding message type
  */
-void task_prologue()
+void chan_out(const char *field_name, const void *value,
+              size_t var_size, int count, ...)
 {
-    task_t *curtask = curctx->task;
+    va_list ap;
+    int i;
 
-    // Swaps of the self-channel buffer happen on transitions, not restarts.
-    // We detect transitions by comparing the current time with a timestamp.
-    if (curctx->time != curtask->last_execute_time) {
-
-        // Minimize FRAM reads
-        self_field_meta_t **dirty_self_fields = curtask->dirty_self_fields;
-
-        int i;
-
-        // It is safe to repeat the loop for the same element, because the swap
-        // operation clears the dirty bit. We only need to be a little bit careful
-        // to decrement the count strictly after the swap.
-        while ((i = curtask->num_dirty_self_fields) > 0) {
-            self_field_meta_t *self_field = dirty_self_fields[--i];
-
-            if (self_field->idx_pair & SELF_CHAN_IDX_BIT_DIRTY_CURRENT) {
-                // Atomically: swap AND clear the dirty bit (by "moving" it over to MSB)
-                __asm__ volatile (
-                    "SWPB %[idx_pair]\n"
-                    : [idx_pair]  "=m" (self_field->idx_pair)
-                );
-            }
+    PROFILE_SITE_BEGIN();
 
-            // Trade-off: either we do one FRAM write after each element, or
-            // we do only one write at the end (set to 0) but also not make
-            // forward progress if we reboot in the middle of this loop.
-            // We opt for making progress.
-            curtask->num_dirty_self_fields = i;
-        }
+    va_start(ap, count);
 
-        curtask->last_execute_time = curctx->time;
-    } else {
-        // In this case, swapping that needed to take place after the last
-        // transition has run to completion (even if it was restarted) [because
-        // the last_execute_time was set]. We get into this clause only
-        // because of a restart. We must clear any state that the incomplete
-        // execution of the task might have changed.
-        curtask->num_dirty_self_fields = 0;
+    for (i = 0; i < count; ++i) {
+        uint8_t *chan = va_arg(ap, uint8_t *);
+        size_t field_offset = va_arg(ap, size_t);
+
+#ifdef LIBCHAIN_ENABLE_CACHE
+        if (cache_out(field_name, value, var_size, chan, field_offset))
+            continue;
+#endif // LIBCHAIN_ENABLE_CACHE
+        chan_out_one(field_name, value, var_size, chan, field_offset);
     }
+
+    va_end(ap);
+
+    PROFILE_SITE_END(1);
 }
 
-/**
- * @brief Transfer control to the given task
- * @details Finalize the current task and jump to the given task.
- *          This function does not return.
- *
- *  TODO: mark this function as bare (i.e. no prologue) for efficiency
+/** @brief Write a value to a field in a channel and track it as the latest writer
+ *  @param field_name    string name of the field, used for diagnostics
+ *  @param value         pointer to value data
+ *  @param var_size      size of the 'variable' type (var_meta_t + value type)
+ *  @param chan          channel ptr (not a self-channel)
+ *  @param field_offset  field offset in the message type of the channel
+ *  @param count         number of join fields (one per destination task)
+ *  @param ...           join field ptrs of the destinations of the channel
  */
-void transition_to(task_t *next_task)
+void chan_out_join(const char *field_name, const void *value, size_t var_size,
+                   void *chan, size_t field_offset, int count, ...)
 {
-    context_t *next_ctx; // this should be in a register for efficiency
-                         // (if we really care, write this func in asm)
+    va_list ap;
+    int i;
 
-    // reset stack pointer
-    // update current task pointer
-    // tick logical time
-    // jump to next task
+    CACHE_WRITE_BACK();
 
-    // NOTE: the order of these does not seem to matter, a reboot
-    // at any point in this sequence seems to be harmless.
-    //
-    // NOTE: It might be a bit cleaner to reset the stack and
-    // set the current task pointer in the function *prologue* --
-    // would need compiler support for this.
-    //
-    // NOTE: It is harmless to increment the time even if we fail before
-    // transitioning to the next task. The reverse, i.e. failure to increment
-    // time while having transitioned to the task, would break the
-    // semantics of CHAN_IN (aka. sync), which should get the most recently
-    // updated value.
-    //
-    // NOTE: Storing two pointers (one to next and one to current context)
-    // does not seem acceptable, because the two would need to be kept
-    // consistent in the face of intermittence. But, could keep one pointer
-    // to current context and a pointer to next context inside the context
-    // structure. The only reason to do that is if it is more efficient --
-    // i.e. avoids XORing the index and getting the actual pointer.
-
-    // TODO: handle overflow of timestamp. Some very raw ideas:
-    //          * limit the age of values
-    //          * a maintainance task that fixes up stored timestamps
-    //          * extra bit to mark timestamps as pre/post overflow
-
-    // TODO: re-use the top-of-stack address used in entry point, instead
-    //       of hardcoding the address.
-    //
-    //       Probably need to write a custom entry point in asm, and
-    //       use it instead of the C runtime one.
+    var_meta_t *var = chan_out_one(field_name, value, var_size,
+                                   (uint8_t *)chan, field_offset);
 
-    next_ctx = curctx->next_ctx;
-    next_ctx->task = next_task;
-    next_ctx->time = curctx->time + 1;
+    // The value is written (with its timestamp) strictly before it is
+    // published, and the publishing is a single-word store. A restart of the
+    // writer after publishing is harmless, because values in task-to-task
+    // channels are not rolled back on restart either.
+    va_start(ap, count);
+    for (i = 0; i < count; ++i) {
+        join_field_t *join = va_arg(ap, join_field_t *);
+        join->var = var;
+        FAIL_POINT();
+    }
+    va_end(ap);
+}
 
-    next_ctx->next_ctx = curctx;
-    curctx = next_ctx;
+/** @brief Sync a join field: return the value from its latest writer
+ *  @param field_name    string name of the field, used for diagnostics
+ *  @param var_size      size of the 'variable' type (var_meta_t + value type)
+ *  @param join          join field of the reading task
+ *  @param self_chan     the self-channel of the reading task, or NULL
+ *  @param field_offset  field offset in the message type of the self-channel
+ *  @return Pointer to the value, ready to be cast to final value type pointer
+ *
+ *  Self-channel writes are rolled back on restart, so they are not
+ *  tracked in the join field (rolling back the join field too would cost
+ *  a log). Instead, the self-channel field is compared with the tracked
+ *  writer: the cost is constant, regardless of the number of writers.
+ */
+void *chan_in_join(const char *field_name, size_t var_size, join_field_t *join,
+                   void *self_chan, size_t field_offset)
+{
+    CACHE_WRITE_BACK();
+    var_meta_t *var = join->var;
 
-    task_prologue();
+    FAIL_POINT();
 
-    __asm__ volatile ( // volatile because output operands unused by C
-        "mov #0x2400, r1\n"
-        "br %[ntask]\n"
-        :
-        : [ntask] "r" (next_task->func)
-    );
+    if (self_chan) {
+        var_meta_t *self_var = chan_in_var((uint8_t *)self_chan, field_offset, var_size);
 
-    // Alternative:
-    // task-function prologue:
-    //     mov pc, curtask 
-    //     mov #0x2400, sp
-    //
-    // transition_to(next_task->func):
-    //     br next_task
+        if (!var || chain_stamp_newer(self_var, chain_stamp_age(self_var->timestamp),
+                                      var, chain_stamp_age(var->timestamp)))
+            var = self_var;
+    }
+
+    LIBCHAIN_PRINTF("[%u] %s: in: '%s': join v%04x [%u]\r\n", curctx->time,
+                    chain_task->name, field_name,
+                    (uint16_t)(uintptr_t)var, var->timestamp);
+
+    return (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
 }
 
-/** @brief Sync: return the most recently updated value of a given field
- *  @param field_name   string name of the field, used for diagnostics
- *  @param var_size     size of the 'variable' type (var_meta_t + value type)
- *  @param count        number of channels to sync
- *  @param ...          channel ptr, field offset in corresponding message type
- *  @return Pointer to the value, ready to be cast to final value type pointer
+/** @brief Pointer to a field in a channel */
+static inline uint8_t *chan_field(uint8_t *chan, size_t field_offset)
+{
+    return chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data) + field_offset;
+}
+
+/** @brief Sync a block of a block-versioned array field
+ *  @param field_name    string name of the field, used for diagnostics
+ *  @param block         index of the block
+ *  @param block_size    size of a block of values in bytes
+ *  @param value_offset  offset of the values in the field
+ *  @param count         number of channels
+ *  @param ...           channel ptr, field offset in corresponding message type
+ *  @return Pointer to the first value of the block in the channel
+ *          where the block was most recently updated
  */
-void *chan_in(const char *field_name, size_t var_size, int count, ...)
+void *chan_in_block(const char *field_name, unsigned block, size_t block_size,
+                    size_t value_offset, int count, ...)
 {
     va_list ap;
-    unsigned i;
-    unsigned latest_update = 0;
-#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
-    unsigned latest_chan_idx = 0;
-#endif
+    int i;
+    chain_time_t latest_age = CHAIN_TIME_NEVER;
+    var_meta_t *latest_meta = NULL;
+    uint8_t *latest_field = NULL;
 
-    var_meta_t *var;
-    var_meta_t *latest_var = NULL;
+    CACHE_WRITE_BACK();
 
-    LIBCHAIN_PRINTF("[%u] %s: in: '%s':", curctx->time,
-                    curctx->task->name, field_name);
+    FAIL_POINT();
 
     va_start(ap, count);
-
     for (i = 0; i < count; ++i) {
         uint8_t *chan = va_arg(ap, uint8_t *);
-        size_t field_offset = va_arg(ap, unsigned);
+        size_t field_offset = va_arg(ap, size_t);
+        uint8_t *field = chan_field(chan, field_offset);
+        var_meta_t *meta = (var_meta_t *)field + block;
 
-        uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
-        chan_meta_t *chan_meta = (chan_meta_t *)(chan +
-                                    offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
-        uint8_t *field = chan_data + field_offset;
+        chain_time_t age = chain_stamp_age(meta->timestamp);
+        if (!latest_field || chain_stamp_newer(meta, age, latest_meta, latest_age)) {
+            latest_age = age;
+            latest_meta = meta;
+            latest_field = field;
+        }
+    }
+    va_end(ap);
 
-        switch (chan_meta->type) {
-            case CHAN_TYPE_SELF: {
-                self_field_meta_t *self_field = (self_field_meta_t *)field;
+    LIBCHAIN_PRINTF("[%u] %s: in: '%s'[blk %u]: f%04x [%u]\r\n", curctx->time,
+                    chain_task->name, field_name, block,
+                    (uint16_t)(uintptr_t)latest_field, latest_meta->timestamp);
 
-                unsigned var_offset =
-                    (self_field->idx_pair & SELF_CHAN_IDX_BIT_CURRENT) ? var_size : 0;
+    return latest_field + value_offset + block * block_size;
+}
 
-                var = (var_meta_t *)(field +
-                        offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
+/** @brief Read a range of values from a block-versioned array field
+ *  @param field_name    string name of the field, used for diagnostics
+ *  @param dest          buffer to copy the values into
+ *  @param start         offset of the first value in bytes
+ *  @param size          size of the range in bytes
+ *  @param block_size    size of a block of values in bytes
+ *  @param value_offset  offset of the values in the field
+ *  @param count         number of channels
+ *  @param ...           channel ptr, field offset in corresponding message type
+ *  @details Each block that overlaps the range is copied from the channel
+ *           where that block was most recently updated.
+ */
+void chan_in_range(const char *field_name, void *dest, size_t start, size_t size,
+                   size_t block_size, size_t value_offset, int count, ...)
+{
+    va_list ap, aq;
+    int i;
+    unsigned block = start / block_size;
+    size_t end = start + size;
+    uint8_t *out = dest;
 
-                break;
-            }
-            default:
-                var = (var_meta_t *)(field +
-                        offsetof(FIELD_TYPE(void_type_t), var));
-        }
+    CACHE_WRITE_BACK();
 
-        LIBCHAIN_PRINTF(" {%u} %s->%s c%04x:off%u:v%04x [%u],", i,
-               chan_meta->diag.source_name, chan_meta->diag.dest_name,
-               (uint16_t)chan, field_offset,
-               (uint16_t)var, var->timestamp);
+    FAIL_POINT();
 
-        if (var->timestamp > latest_update) {
-            latest_update = var->timestamp;
-            latest_var = var;
-#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
-            latest_chan_idx = i;
-#endif
-        }
-    }
-    va_end(ap);
+    va_start(ap, count);
+    while (start < end) {
+        chain_time_t latest_age = CHAIN_TIME_NEVER;
+        var_meta_t *latest_meta = NULL;
+        uint8_t *latest_field = NULL;
+        size_t block_end = (block + 1) * block_size;
+        size_t len = (block_end < end ? block_end : end) - start;
 
-    LIBCHAIN_PRINTF(": {latest %u}: ", latest_chan_idx);
+        va_copy(aq, ap);
+        for (i = 0; i < count; ++i) {
+            uint8_t *chan = va_arg(aq, uint8_t *);
+            size_t field_offset = va_arg(aq, size_t);
+            uint8_t *field = chan_field(chan, field_offset);
+            var_meta_t *meta = (var_meta_t *)field + block;
 
-    uint8_t *value = (uint8_t *)latest_var + offsetof(VAR_TYPE(void_type_t), value);
+            chain_time_t age = chain_stamp_age(meta->timestamp);
+            if (!latest_field || chain_stamp_newer(meta, age, latest_meta, latest_age)) {
+                latest_age = age;
+                latest_meta = meta;
+                latest_field = field;
+            }
+        }
+        va_end(aq);
 
-#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
-    for (int i = 0; i < var_size - sizeof(var_meta_t); ++i)
-        LIBCHAIN_PRINTF("%02x ", value[i]);
-    LIBCHAIN_PRINTF("\r\n");
-#endif
+        LIBCHAIN_PRINTF("[%u] %s: in: '%s'[%u:%u]: f%04x [%u]\r\n", curctx->time,
+                        chain_task->name, field_name, (unsigned)start,
+                        (unsigned)(start + len),
+                        (uint16_t)(uintptr_t)latest_field, latest_meta->timestamp);
 
-    // TODO: No two timestamps compared above can be equal.
-    //       How can two different sources (i.e. different tasks) write to
-    //       this destination at the same logical time? Pretty sure, this is
-    //       impossible.
-    // ASSERT(latest_field != NULL);
+        memcpy(out, latest_field + value_offset + start, len);
 
-    return (void *)value;
+        out += len;
+        start += len;
+        ++block;
+    }
+    va_end(ap);
 }
 
-/** @brief Write a value to a field in a channel
+/** @brief Write a range of values into a block-versioned array field
  *  @param field_name    string name of the field, used for diagnostics
- *  @param value         pointer to value data
- *  @param var_size      size of the 'variable' type (var_meta_t + value type)
- *  @param count         number of output channels
+ *  @param src           values to write
+ *  @param start         offset of the first value in bytes
+ *  @param size          size of the range in bytes
+ *  @param block_size    size of a block of values in bytes
+ *  @param value_offset  offset of the values in the field
+ *  @param count         number of channels
  *  @param ...           channel ptr, field offset in corresponding message type
+ *  @details Timestamps are per block, so a block that is written partially
+ *           becomes the latest version of the whole block: values of the
+ *           block not in the range are whatever this channel held before.
  */
-void chan_out(const char *field_name, const void *value,
-              size_t var_size, int count, ...)
+void chan_out_range(const char *field_name, const void *src, size_t start, size_t size,
+                    size_t block_size, size_t value_offset, int count, ...)
 {
     va_list ap;
     int i;
-    var_meta_t *var;
+    unsigned first_block = start / block_size;
+    unsigned last_block = (start + size - 1) / block_size;
 
-    va_start(ap, count);
+    CACHE_WRITE_BACK();
+
+    if (!size)
+        return;
 
+    va_start(ap, count);
     for (i = 0; i < count; ++i) {
         uint8_t *chan = va_arg(ap, uint8_t *);
-        size_t field_offset = va_arg(ap, unsigned);
+        size_t field_offset = va_arg(ap, size_t);
+        uint8_t *field = chan_field(chan, field_offset);
+        unsigned block;
 
-        uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
-        chan_meta_t *chan_meta = (chan_meta_t *)(chan +
-                                    offsetof(CH_TYPE(_sb, _db, _void_type_t), meta));
-        uint8_t *field = chan_data + field_offset;
-
-        switch (chan_meta->type) {
-            case CHAN_TYPE_SELF: {
-                self_field_meta_t *self_field = (self_field_meta_t *)field;
-                task_t *curtask = curctx->task;
-
-                unsigned var_offset =
-                    (self_field->idx_pair & SELF_CHAN_IDX_BIT_NEXT) ? var_size : 0;
-
-                var = (var_meta_t *)(field +
-                        offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
-
-                // "Enqueue" the buffer index to be flipped on next transition:
-                //   (1) initialize the dirty bit for next swap, or, in other words,
-                //       "finalize" clearing of the dirty bit from the previous
-                //       swap, since the swap "clears" the dirty bit by moving
-                //       it over from LSB to MSB.
-                //   (2) mark the index dirty, which enques the swap
-                //   (3) add the field to the list of dirty fields
-                //
-                // NOTE: these do not have to be atomic, and can be repeated any
-                // number of times (idempotent). Counter of the dirty list is
-                // reset on in task prologue.
-                self_field->idx_pair &= ~(SELF_CHAN_IDX_BIT_DIRTY_NEXT);
-                self_field->idx_pair |= SELF_CHAN_IDX_BIT_DIRTY_CURRENT;
-                curtask->dirty_self_fields[curtask->num_dirty_self_fields++] = self_field;
+        LIBCHAIN_PRINTF("[%u] %s: out: '%s'[%u:%u]: f%04x\r\n", curctx->time,
+                        chain_task->name, field_name, (unsigned)start,
+                        (unsigned)(start + size), (uint16_t)(uintptr_t)field);
 
-                break;
-            }
-            default:
-                var = (var_meta_t *)(field +
-                        offsetof(FIELD_TYPE(void_type_t), var));
-        }
+        for (block = first_block; block <= last_block; ++block)
+            chain_stamp((var_meta_t *)field + block);
+        FAIL_POINT();
 
-#ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
-        LIBCHAIN_PRINTF("[%u] %s: out: '%s': %s -> %s c%04x:off%u:v%04x: ",
-               curctx->time, curctx->task->name, field_name,
-               chan_meta->diag.source_name, chan_meta->diag.dest_name,
-               (uint16_t)chan, field_offset, (uint16_t)var);
+        memcpy(field + value_offset + start, src, size);
+        COUNT(chain_task, bytes_written, size);
+        TRACE(CHAIN_TRACE_OUT, chain_task, chan, field_offset);
+    }
+    va_end(ap);
+}
 
-        for (int i = 0; i < var_size - sizeof(var_meta_t); ++i)
-            LIBCHAIN_PRINTF("%02x ", *((uint8_t *)value + i));
-        LIBCHAIN_PRINTF("\r\n");
-#endif
+void chain_counters_get(const task_t *task, chain_counters_t *counters)
+{
+#ifdef LIBCHAIN_ENABLE_COUNTERS
+    *counters = *task->counters;
+#else // !LIBCHAIN_ENABLE_COUNTERS
+    memset(counters, 0, sizeof(*counters));
+#endif // !LIBCHAIN_ENABLE_COUNTERS
+}
+
+void chain_counters_reset(const task_t *task)
+{
+#ifdef LIBCHAIN_ENABLE_COUNTERS
+    memset(task->counters, 0, sizeof(*task->counters));
+#endif // LIBCHAIN_ENABLE_COUNTERS
+}
+
+unsigned fifo_push(fifo_t *fifo, const void *elems, size_t elem_size, unsigned n)
+{
+    if (elem_size != fifo->elem_size)
+        LIBCHAIN_FATAL("element size does not match the FIFO");
+
+    unsigned tail = fifo_end_stage(&fifo->tail);
+    unsigned space = fifo->capacity -
+                     fifo_distance(fifo, fifo_end_committed(&fifo->head), tail);
+
+    if (n > space)
+        n = space;
+
+    fifo_copy(fifo, tail, (uint8_t *)elems, n, 1);
+    FAIL_POINT();
+    fifo->tail.staged = fifo_advance(fifo, tail, n);
+    FAIL_POINT();
+
+    COUNT(chain_task, bytes_written, n * elem_size);
+    TRACE(CHAIN_TRACE_OUT, chain_task, fifo, n);
+    return n;
+}
+
+unsigned fifo_pop(fifo_t *fifo, void *elems, size_t elem_size, unsigned n)
+{
+    if (elem_size != fifo->elem_size)
+        LIBCHAIN_FATAL("element size does not match the FIFO");
+
+    unsigned head = fifo_end_stage(&fifo->head);
+    unsigned count = fifo_distance(fifo, head, fifo_end_committed(&fifo->tail));
+
+    if (n > count)
+        n = count;
+
+    fifo_copy(fifo, head, elems, n, 0);
+    fifo->head.staged = fifo_advance(fifo, head, n);
+    FAIL_POINT();
+
+    TRACE(CHAIN_TRACE_IN, chain_task, fifo, n);
+    return n;
+}
+
+unsigned fifo_count(fifo_t *fifo)
+{
+    return fifo_distance(fifo, fifo->head.staged, fifo_end_committed(&fifo->tail));
+}
+
+unsigned fifo_space(fifo_t *fifo)
+{
+    return fifo->capacity -
+           fifo_distance(fifo, fifo_end_committed(&fifo->head), fifo->tail.staged);
+}
+
+/** @brief Save the progress of the current execution of the task
+ *  @details The state and the position in the lists of self-channel writes
+ *           go into the slot that does not hold the latest checkpoint, which
+ *           is then committed by switching the slot index. The fields
+ *           written so far are marked, so that the first write of each after
+ *           the checkpoint saves the staged value into the undo log first.
+ *           Marks made before a power failure interrupts the checkpoint are
+ *           harmless: the fields listed since the previous checkpoint are
+ *           unlisted, and the others are marked for it too.
+ */
+void task_checkpoint(const void *state, size_t size)
+{
+    // The checkpoint keeps the writes made before it
+    CACHE_WRITE_BACK();
 
-        var->timestamp = curctx->time;
-        void *var_value = (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
-        memcpy(var_value, value, var_size - sizeof(var_meta_t));
+    const task_t *curtask = chain_task;
+    checkpoint_t *checkpoint = curtask->checkpoint;
+
+    if (!checkpoint || size > checkpoint->size)
+        LIBCHAIN_FATAL("checkpoint state does not fit the storage of the task");
+
+    unsigned next_slot = checkpoint->slot ^ 1;
+    checkpoint_slot_t *slot = &checkpoint->slots[next_slot];
+
+    memcpy(checkpoint->data + next_slot * checkpoint->size, state, size);
+    FAIL_POINT();
+    slot->num_dirty_self_fields = curtask->state->num_dirty_self_fields;
+    slot->self_log_used = curtask->self_log ? curtask->self_log->used : 0;
+    for (fifo_t * const *f = __start_chain_fifos; f < __stop_chain_fifos; ++f) {
+        if ((*f)->producer == curtask)
+            (*f)->tail.checkpoint[next_slot] = (*f)->tail.staged;
+        if ((*f)->consumer == curtask)
+            (*f)->head.checkpoint[next_slot] = (*f)->head.staged;
+    }
+    for (unsigned i = 0; i < slot->num_dirty_self_fields; ++i) {
+        curtask->dirty_self_fields[i]->idx_pair |= SELF_CHAN_IDX_BIT_CHECKPOINT_CURRENT;
+        FAIL_POINT();
     }
+    slot->undo_used = 0;
+    slot->time = curctx->time;
+    FAIL_POINT();
+    checkpoint->slot = next_slot;
+    FAIL_POINT();
 
-    va_end(ap);
+    TRACE(CHAIN_TRACE_CHECKPOINT, curtask, NULL, next_slot);
 }
 
-/** @brief Entry point upon reboot */
-int chain_main() {
+/** @brief Save the staged value of a field that the latest checkpoint kept
+ *  @details Called before the first write of the field after the checkpoint.
+ *           The mark is cleared only once the entry is complete, so a
+ *           repeated save is harmless.
+ */
+void task_checkpoint_save(self_field_meta_t *self_field, var_meta_t *var, size_t var_size)
+{
+    checkpoint_t *checkpoint = chain_task->checkpoint;
+    checkpoint_slot_t *slot = &checkpoint->slots[checkpoint->slot];
+    unsigned used = slot->undo_used;
+    unsigned entry_size = sizeof(checkpoint_undo_entry_t) + SELF_LOG_ALIGN(var_size);
+
+    if (used + entry_size > checkpoint->undo_size)
+        LIBCHAIN_FATAL("checkpoint undo log overflow");
+
+    checkpoint_undo_entry_t *hdr = (checkpoint_undo_entry_t *)(checkpoint->undo + used);
+    hdr->self_field = self_field;
+    hdr->var = var;
+    hdr->var_size = var_size;
+    memcpy(hdr + 1, var, var_size);
+    FAIL_POINT();
+    slot->undo_used = used + entry_size;
+    FAIL_POINT();
+    self_field->idx_pair &= ~SELF_CHAN_IDX_BIT_CHECKPOINT_CURRENT;
+    FAIL_POINT();
+}
+
+int task_resume(void *state, size_t size)
+{
+    const task_t *curtask = chain_task;
+    checkpoint_t *checkpoint = curtask->checkpoint;
+
+    if (!checkpoint_latest(curtask))
+        return 0;
+
+    memcpy(state, checkpoint->data + checkpoint->slot * checkpoint->size, size);
+    return 1;
+}
+
+/** @brief Start a BATCH_LOOP
+ *  @return The number of iterations in the batch
+ */
+unsigned chain_batch_begin()
+{
+    batch_running = 1;
+    return chain_task->state->batch;
+}
+
+int chain_event_post(unsigned priority, unsigned type, unsigned data)
+{
+    event_queue_t *queue;
+    unsigned tail;
+    chain_event_t *event;
+
+    if (priority >= LIBCHAIN_EVENT_PRIORITIES)
+        return -1;
+
+    queue = &event_queues[priority];
+    tail = queue->tail;
+    if (tail - queue->head == LIBCHAIN_EVENT_QUEUE_SIZE)
+        return -1;
+
+    // The single-word write of the tail publishes the event: the compiler
+    // must not move the writes of the event past it
+    event = &queue->events[tail % LIBCHAIN_EVENT_QUEUE_SIZE];
+    event->type = type;
+    event->data = data;
+    __asm__ volatile ("" ::: "memory");
+    queue->tail = tail + 1;
+
+    events_pending = 1;
+    return 0;
+}
+
+const chain_event_t *chain_event_current()
+{
+    return &event_dispatch_state.event;
+}
+
+void chain_event_return()
+{
+    // Ends the handler once the transition commits (see task_prologue)
+    event_dispatch_state.end = time_next(chain_now);
+    FAIL_POINT();
+    transition_to(event_dispatch_state.resume);
+    __builtin_unreachable();
+}
+
+void chain_event_wait()
+{
+#ifdef LIBCHAIN_HOST
+    chain_host_wait(&events_pending);
+#else // !LIBCHAIN_HOST
+    // Interrupts are disabled while checking, so that a post cannot slip in
+    // between the check and the sleep; entering the sleep enables them.
+    __disable_interrupt();
+    while (!events_pending) {
+        __bis_SR_register(LIBCHAIN_EVENT_LPM_BITS | GIE);
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+#endif // !LIBCHAIN_HOST
+}
+
+/** @brief Bookkeeping common to every reboot
+ *  @return The task to resume: the last task that started but did not finish
+ */
+const task_t *chain_boot()
+{
     _numBoots++;
+    boot_epoch = _numBoots ? _numBoots : 1;
+    batch_running = 0;
+    wait_requested = 0;
+    CACHE_RESET();
+#ifdef LIBCHAIN_ENABLE_PROFILE
+    profile_timer_init();
+    profile.ended = NULL;
+#endif // LIBCHAIN_ENABLE_PROFILE
+
+    // The current slot is the one that follows the other in logical time
+    curctx = (contexts[0].time == time_next(contexts[1].time)) ?
+                &contexts[0] : &contexts[1];
+    task_idx_t task = curctx->task & ~CONTEXT_PROLOGUE;
+    chain_task = task == CONTEXT_ENTRY_TASK ? TASK_REF(_entry_task) : TASK_AT(task);
+    context_call_depth[0] = contexts[0].call_depth;
+    context_call_depth[1] = contexts[1].call_depth;
+    call_depth = curctx->call_depth;
+    chain_now = curctx->time;
+    era = curctx->era;
+
+    // Events may have been posted before the power failure
+    events_pending = 1;
+    if (event_handler_active())
+        event_dequeue();
+
+    TRACE(CHAIN_TRACE_BOOT, chain_task, NULL, 0);
 
-    // Resume execution at the last task that started but did not finish
+#ifdef LIBCHAIN_ENABLE_SLEEP
+    // Power failed during the sleep of a deferred transition
+    if (chain_wait.time == curctx->time)
+        chain_sleep_until(chain_wait.deadline);
+#endif // LIBCHAIN_ENABLE_SLEEP
 
     // TODO: using the raw transtion would be possible once the
     //       prologue discussed in chain.h is implemented (requires compiler
@@ -326,11 +2229,91 @@ int chain_main() {
 
     task_prologue();
 
+    return chain_task;
+}
+
+/** @brief Entry point upon reboot */
+int chain_main() {
+#ifdef LIBCHAIN_HOST
+    return chain_host_main();
+#else // !LIBCHAIN_HOST
+    const task_t *curtask = chain_boot();
+
     __asm__ volatile ( // volatile because output operands unused by C
         "br %[nt]\n"
         : /* no outputs */
-        : [nt] "r" (curctx->task->func)
+        : [nt] "r" (curtask->func)
+    );
+
+    __builtin_unreachable(); // the tasks transition to each other forever
+#endif // !LIBCHAIN_HOST
+}
+
+#if defined(LIBCHAIN_ENABLE_ENTRY) && !defined(LIBCHAIN_HOST)
+/* Provided by the linker script (the same symbols that crt0 uses); the
+ * addresses of the *size symbols are the sizes */
+extern uint16_t __datastart[], __romdatastart[], __romdatacopysize[];
+extern uint16_t __bssstart[], __bsssize[];
+
+void chain_start_early() __attribute__((weak));
+
+/**
+ * @brief Reset entry point: from the reset vector to the task to resume
+ * @details Replaces crt0 and main: the stack pointer is set once here, and
+ *          never again until the next transition; the work of crt0 is
+ *          reduced to what a C application needs, and the task is reached
+ *          by a branch, without the frames of main and chain_main.
+ */
+__attribute__((naked)) void chain_start()
+{
+    __asm__ volatile (
+        "mov #__stack, r1\n"
+        "br #chain_start_boot\n"
     );
+}
+
+/* Internal: the part of the entry point that runs on the stack */
+void chain_start_boot() __attribute__((noreturn, used));
+void chain_start_boot()
+{
+    // The memory initialization below may outlast the watchdog interval
+    WDTCTL = WDTPW | WDTHOLD;
+
+    if (chain_start_early)
+        chain_start_early();
+
+    // Word loops: both sections are word-aligned and their sizes even.
+    // There is nothing to copy if .data was linked to run where it is loaded
+    // (e.g. into FRAM), nor anything to zero in an application without .bss.
+    if (&__datastart[0] != &__romdatastart[0]) {
+        uint16_t *dst = __datastart, *src = __romdatastart;
+        uint16_t *end = (uint16_t *)((uint8_t *)__datastart + (size_t)__romdatacopysize);
+        while (dst != end)
+            *dst++ = *src++;
+    }
+    {
+        uint16_t *dst = __bssstart;
+        uint16_t *end = (uint16_t *)((uint8_t *)__bssstart + (size_t)__bsssize);
+        while (dst != end)
+            *dst++ = 0;
+    }
+
+    init();
 
-    return 0; // TODO: write our own entry point and get rid of this
+    const task_t *curtask = chain_boot();
+
+    __asm__ volatile ( // volatile because output operands unused by C
+        "br %[nt]\n"
+        : /* no outputs */
+        : [nt] "r" (curtask->func)
+    );
+    __builtin_unreachable();
 }
+
+/* Reset vector: the entry point replaces the one of crt0 */
+__asm__ (
+    ".section .resetvec, \"a\"\n"
+    ".word chain_start\n"
+    ".previous\n"
+);
+#endif // LIBCHAIN_ENABLE_ENTRY && !LIBCHAIN_HOST
@@ -0,0 +1,745 @@
+#define _GNU_SOURCE // for the register names in ucontext_t
+
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "chain.h"
+
+/* Bounds of the section that holds all __nv variables (provided by the linker) */
+extern uint8_t __start_chain_nv[];
+extern uint8_t __stop_chain_nv[];
+
+/* Reasons for unwinding back to the dispatch loop in chain_host_main */
+enum {
+    UNWIND_BOOT = 0,
+    UNWIND_TRANSITION,
+    UNWIND_POWER_FAILURE,
+    UNWIND_HALT,
+};
+
+static chain_host_config_t config;
+static int configured = 0;
+
+static chain_host_stats_t stats;
+static struct timespec start_time;
+
+static chain_time_t last_logical_time;
+
+static jmp_buf dispatch_env;
+static const task_t *next_task;
+
+static unsigned long points_until_failure;
+static FILE *fail_trace;
+
+/* State of the energy model (see chain_host_energy_t) */
+static struct {
+    double *seg_duration;       // segments of the harvesting trace
+    double *seg_power;
+    unsigned num_segs;
+    unsigned seg;               // current segment
+    double seg_left;            // time left in the current segment
+    double total_j;             // harvested over the whole trace
+    double stored_j;
+    double on_j, off_j;         // stored energy at the thresholds
+    double committed_j;         // consumed when the last transition committed
+    unsigned long nv_accesses;  // counted when last charged
+} energy;
+
+static void die(const char *what)
+{
+    fprintf(stderr, "libchain: host: %s: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static unsigned long env_ulong(const char *name)
+{
+    const char *value = getenv(name);
+    return value ? strtoul(value, NULL, 0) : 0;
+}
+
+static double env_double(const char *name)
+{
+    const char *value = getenv(name);
+    return value ? strtod(value, NULL) : 0;
+}
+
+static void configure_from_env()
+{
+    memset(&config, 0, sizeof(config));
+
+    config.nv_file = getenv("LIBCHAIN_HOST_NV_FILE");
+
+    if ((config.fail_interval = env_ulong("LIBCHAIN_HOST_FAIL_EVERY")))
+        config.fail_mode = CHAIN_HOST_FAIL_EVERY;
+    else if ((config.fail_interval = env_ulong("LIBCHAIN_HOST_FAIL_RANDOM")))
+        config.fail_mode = CHAIN_HOST_FAIL_RANDOM;
+    else if ((config.fail_trace = getenv("LIBCHAIN_HOST_FAIL_TRACE")))
+        config.fail_mode = CHAIN_HOST_FAIL_TRACE;
+    else if ((config.energy.trace = getenv("LIBCHAIN_HOST_ENERGY_TRACE")) ||
+             (config.energy.power_w = env_double("LIBCHAIN_HOST_ENERGY_POWER")))
+        config.fail_mode = CHAIN_HOST_FAIL_ENERGY;
+
+    config.energy.capacitance_f = env_double("LIBCHAIN_HOST_ENERGY_CAP_UF") * 1e-6;
+    config.energy.v_on = env_double("LIBCHAIN_HOST_ENERGY_V_ON");
+    config.energy.v_off = env_double("LIBCHAIN_HOST_ENERGY_V_OFF");
+    config.energy.clock_hz = env_double("LIBCHAIN_HOST_ENERGY_CLOCK_HZ");
+    config.energy.j_per_cycle = env_double("LIBCHAIN_HOST_ENERGY_NJ_CYCLE") * 1e-9;
+    config.energy.j_per_nv_access = env_double("LIBCHAIN_HOST_ENERGY_NJ_NV") * 1e-9;
+    config.energy.tick_cycles = env_ulong("LIBCHAIN_HOST_ENERGY_TICK");
+    config.energy.point_cycles = env_ulong("LIBCHAIN_HOST_ENERGY_POINT");
+    config.energy.boot_cycles = env_ulong("LIBCHAIN_HOST_ENERGY_BOOT");
+    config.energy.count_nv = getenv("LIBCHAIN_HOST_ENERGY_COUNT_NV") != NULL;
+
+    config.seed = env_ulong("LIBCHAIN_HOST_SEED");
+    config.max_boots = env_ulong("LIBCHAIN_HOST_MAX_BOOTS");
+    config.max_transitions = env_ulong("LIBCHAIN_HOST_MAX_TRANSITIONS");
+    config.fleet = env_ulong("LIBCHAIN_HOST_FLEET");
+    config.jobs = env_ulong("LIBCHAIN_HOST_JOBS");
+    config.print_stats = getenv("LIBCHAIN_HOST_STATS") != NULL;
+}
+
+void chain_host_configure(const chain_host_config_t *cfg)
+{
+    config = *cfg;
+    configured = 1;
+}
+
+const chain_host_stats_t *chain_host_stats()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats.elapsed_sec = (now.tv_sec - start_time.tv_sec) +
+                        (now.tv_nsec - start_time.tv_nsec) / 1e9;
+    return &stats;
+}
+
+/* Trailer after the mapped pages, identifies the layout the file was written for */
+typedef struct {
+    uintptr_t nv_begin;
+    size_t nv_size;
+} nv_file_trailer_t;
+
+/** @brief Back the __nv section with a shared mapping of a file
+ *  @details The section is generally not page-aligned, so the mapping covers
+ *           the enclosing pages. Bytes of those pages outside of the section
+ *           belong to unrelated variables: they are always written into the
+ *           file from the process image before mapping it, so that only the
+ *           __nv bytes are restored from a previous run.
+ *
+ *           Persistent pointers are valid across runs only if the binary is
+ *           loaded at the same address, so the application must be linked
+ *           with -no-pie. A file written for a different layout is discarded.
+ */
+static void map_nv_file(const char *path)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)__start_chain_nv & ~(page_size - 1);
+    uintptr_t end = ((uintptr_t)__stop_chain_nv + page_size - 1) & ~(page_size - 1);
+    size_t nv_offset = (uintptr_t)__start_chain_nv - begin;
+    size_t nv_size = __stop_chain_nv - __start_chain_nv;
+    size_t map_size = end - begin;
+    nv_file_trailer_t trailer = { (uintptr_t)__start_chain_nv, nv_size };
+    nv_file_trailer_t file_trailer;
+    struct stat st;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        die(path);
+    if (fstat(fd, &st))
+        die(path);
+
+    uint8_t *image = malloc(map_size);
+    if (!image)
+        die("malloc");
+    memcpy(image, (void *)begin, map_size);
+
+    if ((size_t)st.st_size == map_size + sizeof(trailer) &&
+        pread(fd, &file_trailer, sizeof(file_trailer), map_size) == sizeof(file_trailer) &&
+        !memcmp(&file_trailer, &trailer, sizeof(trailer))) {
+        if (pread(fd, image + nv_offset, nv_size, nv_offset) != (ssize_t)nv_size)
+            die(path);
+    } else if (st.st_size) {
+        fprintf(stderr, "libchain: host: %s: layout mismatch, "
+                "discarding persistent state\n", path);
+    }
+
+    if (ftruncate(fd, map_size + sizeof(trailer)))
+        die(path);
+    if (pwrite(fd, image, map_size, 0) != (ssize_t)map_size)
+        die(path);
+    if (pwrite(fd, &trailer, sizeof(trailer), map_size) != sizeof(trailer))
+        die(path);
+    free(image);
+
+    if (mmap((void *)begin, map_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+        die("mmap");
+    close(fd);
+}
+
+static unsigned long next_failure_interval()
+{
+    unsigned long interval;
+
+    switch (config.fail_mode) {
+        case CHAIN_HOST_FAIL_EVERY:
+            return config.fail_interval;
+        case CHAIN_HOST_FAIL_RANDOM:
+            return 1 + (unsigned long)rand() % (2 * config.fail_interval - 1);
+        case CHAIN_HOST_FAIL_TRACE:
+            if (fail_trace && fscanf(fail_trace, "%lu", &interval) == 1)
+                return interval;
+            return 0; // trace exhausted: no more failures
+        default:
+            return 0;
+    }
+}
+
+/** @brief Print the statistics of a run, labeled with its instance if >= 0 */
+static void print_stats(const chain_host_stats_t *s, int instance)
+{
+    char label[16] = "";
+
+    if (instance >= 0)
+        snprintf(label, sizeof(label), "[%d] ", instance);
+
+    fprintf(stderr, "libchain: host: %sboots %lu failures %lu transitions %lu "
+            "points %lu time %.3f s (%.0f boots/s, %.0f transitions/s)\n",
+            label, s->boots, s->power_failures, s->transitions, s->fail_points,
+            s->elapsed_sec, s->boots / s->elapsed_sec,
+            s->transitions / s->elapsed_sec);
+
+    if (s->energy_j > 0)
+        fprintf(stderr, "libchain: host: %senergy %.3g J (%.0f transitions/J, "
+                "%.1f%% wasted) simulated time %.3f s\n",
+                label, s->energy_j, s->transitions / s->energy_j,
+                100 * s->wasted_j / s->energy_j, s->sim_time_sec);
+}
+
+/* State of NV access counting: thread-local, so that it is not in the .data
+ * or .bss pages that may share a page with the protected __nv section */
+static __thread uintptr_t nv_pages_begin, nv_pages_end;
+static __thread int nv_counting;
+static __thread unsigned long nv_reads, nv_writes;
+
+#ifdef __x86_64__
+#define EFLAGS_TF 0x100UL   // trap flag: single-step
+#define PF_ERR_WRITE 0x2UL  // page fault error code: write access
+
+/** @brief System call that does not go through the PLT
+ *  @details The GOT may share a page with the __nv section, so the signal
+ *           handlers must not call into libc while the pages are protected.
+ */
+static inline long raw_syscall4(long n, long a, long b, long c, long d)
+{
+    long ret;
+    register long r10 __asm__("r10") = d;
+    __asm__ volatile ("syscall"
+                      : "=a" (ret)
+                      : "a" (n), "D" (a), "S" (b), "d" (c), "r" (r10)
+                      : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline void nv_pages_protect(int prot)
+{
+    raw_syscall4(SYS_mprotect, nv_pages_begin, nv_pages_end - nv_pages_begin, prot, 0);
+}
+
+/** @brief Count an access to the protected pages and let it proceed
+ *  @details The pages are unprotected for one instruction, after which the
+ *           trap flag brings control to nv_step_handler to protect them again.
+ */
+static void nv_access_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+    uintptr_t addr = (uintptr_t)info->si_addr;
+
+    if (addr < nv_pages_begin || addr >= nv_pages_end) {
+        // A genuine fault: restore the default action, to crash on re-execution
+        struct { void *handler; unsigned long flags; void *restorer; uint64_t mask; }
+            dfl = { SIG_DFL, 0, NULL, 0 };
+        raw_syscall4(SYS_rt_sigaction, SIGSEGV, (long)&dfl, 0, sizeof(dfl.mask));
+        return;
+    }
+
+    if (addr >= (uintptr_t)__start_chain_nv && addr < (uintptr_t)__stop_chain_nv) {
+        if (uc->uc_mcontext.gregs[REG_ERR] & PF_ERR_WRITE)
+            ++nv_writes;
+        else
+            ++nv_reads;
+    }
+
+    nv_pages_protect(PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+}
+
+static void nv_step_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *)context;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+    if (nv_counting)
+        nv_pages_protect(PROT_NONE);
+}
+
+int chain_host_count_nv(int enable)
+{
+    if (!nv_pages_begin) {
+        long page_size = sysconf(_SC_PAGESIZE);
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_flags = SA_SIGINFO;
+        sa.sa_sigaction = nv_access_handler;
+        sigaction(SIGSEGV, &sa, NULL);
+        sa.sa_sigaction = nv_step_handler;
+        sigaction(SIGTRAP, &sa, NULL);
+
+        nv_pages_begin = (uintptr_t)__start_chain_nv & ~(page_size - 1);
+        nv_pages_end = ((uintptr_t)__stop_chain_nv + page_size - 1) & ~(page_size - 1);
+    }
+
+    nv_counting = enable;
+    nv_pages_protect(enable ? PROT_NONE : PROT_READ | PROT_WRITE);
+    return 0;
+}
+#else // !__x86_64__
+int chain_host_count_nv(int enable)
+{
+    return -1;
+}
+#endif // !__x86_64__
+
+void chain_host_nv_counts(unsigned long *reads, unsigned long *writes)
+{
+    *reads = nv_reads;
+    *writes = nv_writes;
+}
+
+static void energy_defaults(chain_host_energy_t *e)
+{
+    if (!e->capacitance_f)
+        e->capacitance_f = 47e-6;
+    if (!e->v_on)
+        e->v_on = 2.4;
+    if (!e->v_off)
+        e->v_off = 1.8;
+    if (!e->clock_hz)
+        e->clock_hz = 8e6;
+    if (!e->j_per_cycle)
+        e->j_per_cycle = 0.25e-9;
+    if (!e->j_per_nv_access)
+        e->j_per_nv_access = 0.5e-9;
+    if (!e->tick_cycles)
+        e->tick_cycles = 1000;
+    if (!e->point_cycles)
+        e->point_cycles = 50;
+    if (!e->boot_cycles)
+        e->boot_cycles = 5000;
+}
+
+/** @brief Load the harvesting trace, or make a one-segment one of constant power */
+static void energy_load(const chain_host_energy_t *e)
+{
+    unsigned cap = 0;
+    double duration, power;
+
+    energy.num_segs = 0;
+    energy.total_j = 0;
+
+    if (!e->trace) {
+        cap = 1;
+        energy.seg_duration = malloc(sizeof(double));
+        energy.seg_power = malloc(sizeof(double));
+        energy.seg_duration[0] = 1;
+        energy.seg_power[0] = e->power_w;
+        energy.num_segs = 1;
+        energy.total_j = e->power_w;
+    } else {
+        FILE *f = fopen(e->trace, "r");
+        if (!f)
+            die(e->trace);
+        while (fscanf(f, "%lf %lf", &duration, &power) == 2) {
+            if (duration <= 0)
+                continue;
+            if (energy.num_segs == cap) {
+                cap = cap ? 2 * cap : 256;
+                energy.seg_duration = realloc(energy.seg_duration, cap * sizeof(double));
+                energy.seg_power = realloc(energy.seg_power, cap * sizeof(double));
+                if (!energy.seg_duration || !energy.seg_power)
+                    die("realloc");
+            }
+            energy.seg_duration[energy.num_segs] = duration;
+            energy.seg_power[energy.num_segs] = power;
+            energy.total_j += duration * power;
+            ++energy.num_segs;
+        }
+        fclose(f);
+    }
+
+    if (energy.total_j <= 0) {
+        fprintf(stderr, "libchain: host: %s: no energy to harvest\n",
+                e->trace ? e->trace : "LIBCHAIN_HOST_ENERGY_POWER");
+        exit(1);
+    }
+
+    energy.seg = 0;
+    energy.seg_left = energy.seg_duration[0];
+    energy.on_j = e->capacitance_f * e->v_on * e->v_on / 2;
+    energy.off_j = e->capacitance_f * e->v_off * e->v_off / 2;
+    energy.stored_j = 0;
+    energy.committed_j = 0;
+    energy.nv_accesses = 0;
+}
+
+static void energy_next_seg()
+{
+    energy.seg = (energy.seg + 1) % energy.num_segs;
+    energy.seg_left = energy.seg_duration[energy.seg];
+}
+
+/** @brief Start the replay at a point of the trace chosen by the seed */
+static void energy_seek()
+{
+    double t = (double)rand() / RAND_MAX * energy.total_j;
+
+    // Uniform in harvested energy, which skips over the dead periods
+    while (t >= energy.seg_duration[energy.seg] * energy.seg_power[energy.seg]) {
+        t -= energy.seg_duration[energy.seg] * energy.seg_power[energy.seg];
+        energy_next_seg();
+    }
+    energy.seg_left -= t / energy.seg_power[energy.seg];
+}
+
+/** @brief Advance the trace by a period of time while the device is on */
+static void energy_harvest(double dt)
+{
+    stats.sim_time_sec += dt;
+
+    while (dt > 0) {
+        double t = dt < energy.seg_left ? dt : energy.seg_left;
+
+        energy.stored_j += t * energy.seg_power[energy.seg];
+        energy.seg_left -= t;
+        dt -= t;
+        if (energy.seg_left <= 0)
+            energy_next_seg();
+    }
+
+    // The harvester stops charging at the turn-on voltage
+    if (energy.stored_j > energy.on_j)
+        energy.stored_j = energy.on_j;
+}
+
+/** @brief Advance the trace while the device is off, until it turns on */
+static void energy_recharge()
+{
+    while (energy.stored_j < energy.on_j) {
+        double p = energy.seg_power[energy.seg];
+        double need = energy.on_j - energy.stored_j;
+
+        if (p * energy.seg_left >= need) {
+            stats.sim_time_sec += need / p;
+            energy.seg_left -= need / p;
+            energy.stored_j = energy.on_j;
+        } else {
+            stats.sim_time_sec += energy.seg_left;
+            energy.stored_j += p * energy.seg_left;
+            energy_next_seg();
+        }
+    }
+}
+
+/** @brief Charge the energy of some work, and fail if the capacitor runs out
+ *  @param nv_accesses  estimate, replaced by the count when counting
+ */
+static void energy_charge(unsigned long cycles, unsigned long nv_accesses)
+{
+    const chain_host_energy_t *e = &config.energy;
+    double used;
+
+    if (e->count_nv) {
+        unsigned long n = nv_reads + nv_writes;
+        nv_accesses = n - energy.nv_accesses;
+        energy.nv_accesses = n;
+    }
+
+    used = cycles * e->j_per_cycle + nv_accesses * e->j_per_nv_access;
+    stats.energy_j += used;
+    energy_harvest(cycles / e->clock_hz);
+    energy.stored_j -= used;
+
+    if (energy.stored_j < energy.off_j)
+        longjmp(dispatch_env, UNWIND_POWER_FAILURE);
+}
+
+/** @brief Count the transitions committed since the logical time was last seen
+ *  @details Committed transitions, as opposed to transitions interrupted by
+ *           failures. The time is seen on every transition, or on the boot
+ *           after it, so it wrapped around (skipping 0) at most once.
+ */
+static void count_transitions()
+{
+    chain_time_t now = curctx->time;
+
+    stats.transitions += (chain_time_t)(now - last_logical_time) - (now < last_logical_time);
+    last_logical_time = now;
+}
+
+void chain_host_fail_point()
+{
+    ++stats.fail_points;
+
+    if (config.fail_mode == CHAIN_HOST_FAIL_ENERGY)
+        energy_charge(config.energy.point_cycles, 1);
+
+    if (points_until_failure && --points_until_failure == 0)
+        longjmp(dispatch_env, UNWIND_POWER_FAILURE);
+}
+
+void chain_host_tick()
+{
+    if (config.fail_mode == CHAIN_HOST_FAIL_ENERGY)
+        energy_charge(config.energy.tick_cycles, 0);
+
+    chain_host_fail_point();
+}
+
+void chain_host_power_failure()
+{
+    longjmp(dispatch_env, UNWIND_POWER_FAILURE);
+}
+
+void chain_host_halt()
+{
+    longjmp(dispatch_env, UNWIND_HALT);
+}
+
+void chain_host_transition(const task_t *task)
+{
+    count_transitions();
+    if (config.max_transitions && stats.transitions >= config.max_transitions)
+        longjmp(dispatch_env, UNWIND_HALT);
+
+    energy.committed_j = stats.energy_j;
+    next_task = task;
+    longjmp(dispatch_env, UNWIND_TRANSITION);
+}
+
+/** @brief Sleep until a signal handler sets the flag
+ *  @details Signals are blocked while checking the flag, so that one cannot
+ *           be delivered between the check and the wait.
+ */
+void chain_host_wait(volatile unsigned *flag)
+{
+    sigset_t all, old;
+
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &old);
+    while (!*flag)
+        sigsuspend(&old);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void chain_host_sleep(uint32_t ms)
+{
+    struct timespec t = { ms / 1000, (ms % 1000) * 1000000L };
+
+    // The device sleeps in simulated time, drawing no energy
+    if (config.fail_mode == CHAIN_HOST_FAIL_ENERGY) {
+        energy_harvest(ms / 1000.0);
+        return;
+    }
+
+    while (nanosleep(&t, &t) && errno == EINTR)
+        ;
+}
+
+/** @brief Dispatch loop: the stack is reset by unwinding back to here */
+static void run()
+{
+    if (config.nv_file)
+        map_nv_file(config.nv_file);
+    if (config.fail_mode == CHAIN_HOST_FAIL_TRACE) {
+        fail_trace = fopen(config.fail_trace, "r");
+        if (!fail_trace)
+            die(config.fail_trace);
+    }
+    srand(config.seed);
+
+    if (config.fail_mode == CHAIN_HOST_FAIL_ENERGY) {
+        energy_defaults(&config.energy);
+        energy_load(&config.energy);
+        if (config.seed)
+            energy_seek();
+        if (config.energy.count_nv)
+            chain_host_count_nv(1);
+        energy_recharge(); // from an empty capacitor
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    switch (setjmp(dispatch_env)) {
+        case UNWIND_POWER_FAILURE:
+            ++stats.power_failures;
+            if (config.fail_mode == CHAIN_HOST_FAIL_ENERGY) {
+                stats.wasted_j += stats.energy_j - energy.committed_j;
+                energy_recharge();
+            }
+            init(); // application re-initializes the "hardware" on reboot
+            // fall-through
+        case UNWIND_BOOT:
+            ++stats.boots;
+            if (config.max_boots && stats.boots > config.max_boots)
+                goto halt;
+            points_until_failure = next_failure_interval();
+            if (config.fail_mode == CHAIN_HOST_FAIL_ENERGY) {
+                energy_charge(config.energy.boot_cycles, 0);
+                energy.committed_j = stats.energy_j;
+            }
+            next_task = chain_boot();
+            if (stats.boots == 1)
+                last_logical_time = curctx->time;
+            count_transitions();
+            break;
+        case UNWIND_TRANSITION:
+            break;
+        case UNWIND_HALT:
+            goto halt;
+    }
+
+    next_task->func();
+
+    // Tasks end with a transition, falling off the end stops the run
+halt:
+    if (config.energy.count_nv)
+        chain_host_count_nv(0);
+    if (fail_trace)
+        fclose(fail_trace);
+}
+
+int chain_host_fleet(const chain_host_config_t *configs, unsigned count,
+                     unsigned jobs, chain_host_stats_t *results)
+{
+    pid_t *pids = calloc(count, sizeof(pid_t));
+    int *fds = calloc(count, sizeof(int));
+    unsigned started = 0, running = 0, i;
+    int ret = 0;
+
+    if (!pids || !fds)
+        die("calloc");
+    if (!jobs)
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while (started < count || running) {
+        while (started < count && running < jobs) {
+            int fd[2];
+
+            if (pipe(fd))
+                die("pipe");
+            fflush(NULL); // or the child would print buffered output again
+
+            pid_t pid = fork();
+            if (pid < 0)
+                die("fork");
+            if (pid == 0) {
+                // The statistics are smaller than PIPE_BUF: written at once
+                close(fd[0]);
+                config = configs[started];
+                configured = 1;
+                run();
+                if (write(fd[1], chain_host_stats(), sizeof(chain_host_stats_t)) !=
+                    sizeof(chain_host_stats_t))
+                    die("write");
+                fflush(NULL);
+                _exit(0);
+            }
+
+            close(fd[1]);
+            pids[started] = pid;
+            fds[started] = fd[0];
+            ++started;
+            ++running;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            die("wait");
+        for (i = 0; i < started && pids[i] != pid; ++i)
+            ;
+        if (i == started)
+            continue; // not an instance
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) ||
+            read(fds[i], &results[i], sizeof(results[i])) != sizeof(results[i])) {
+            fprintf(stderr, "libchain: host: [%u] instance did not stop normally\n", i);
+            memset(&results[i], 0, sizeof(results[i]));
+            ret = -1;
+        }
+        close(fds[i]);
+        --running;
+    }
+
+    free(pids);
+    free(fds);
+    return ret;
+}
+
+/** @brief Run the instances configured by LIBCHAIN_HOST_FLEET: one per seed
+ *  @details The instances do not map LIBCHAIN_HOST_NV_FILE, which they
+ *           would otherwise share.
+ */
+static void run_fleet()
+{
+    unsigned i, count = config.fleet;
+    chain_host_config_t *configs = calloc(count, sizeof(chain_host_config_t));
+    chain_host_stats_t *results = calloc(count, sizeof(chain_host_stats_t));
+
+    if (!configs || !results)
+        die("calloc");
+
+    for (i = 0; i < count; ++i) {
+        configs[i] = config;
+        configs[i].nv_file = NULL;
+        configs[i].seed = config.seed + i;
+    }
+
+    chain_host_fleet(configs, count, config.jobs, results);
+
+    for (i = 0; i < count; ++i)
+        print_stats(&results[i], i);
+
+    free(configs);
+    free(results);
+}
+
+int chain_host_main()
+{
+    if (!configured)
+        configure_from_env();
+
+    if (config.fleet > 1) {
+        run_fleet();
+        return 0;
+    }
+
+    run();
+    if (config.print_stats)
+        print_stats(chain_host_stats(), -1);
+    return 0;
+}
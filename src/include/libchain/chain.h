@@ -4,20 +4,41 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef LIBCHAIN_HOST
+#include "host.h"
+#else // !LIBCHAIN_HOST
 #include <libmsp/mem.h>
+#endif // !LIBCHAIN_HOST
 
 #include "repeat.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
-#define TASK_NAME_SIZE 32
 #define CHAN_NAME_SIZE 32
 #endif // LIBCHAIN_ENABLE_DIAGNOSTICS
 
-#define MAX_DIRTY_SELF_FIELDS 4
+/** @brief Alignment of the metadata that precedes values in channels
+ *  @details The runtime locates values by offsets computed on a dummy
+ *           pointer-sized type, which is correct only if the metadata
+ *           is at least as aligned as any value. On MSP430 everything is
+ *           word-aligned, so no attribute is needed.
+ */
+#ifndef LIBCHAIN_META_ALIGN
+#define LIBCHAIN_META_ALIGN
+#endif
 
 typedef void (task_func_t)(void);
-typedef unsigned chain_time_t;
-typedef uint32_t task_mask_t;
+
+/** @brief Logical time, which ticks at every transition
+ *  @details A single word on MSP430, so that the transition commits with a
+ *           single write. It wraps around, skipping 0, which marks a value
+ *           as never written. The host uses the same width, to exercise the
+ *           wraparound at the same rate as the device (see LIBCHAIN_STAMPS).
+ */
+typedef uint16_t chain_time_t;
 typedef uint16_t field_mask_t;
 typedef unsigned task_idx_t;
 
@@ -27,6 +48,9 @@ typedef enum {
     CHAN_TYPE_MULTICAST,
     CHAN_TYPE_CALL,
     CHAN_TYPE_RETURN,
+    CHAN_TYPE_SELF_LOG,
+    CHAN_TYPE_FIFO,
+    CHAN_TYPE_VOLATILE,
 } chan_type_t;
 
 // TODO: include diag fields only when diagnostics are enabled
@@ -42,39 +66,318 @@ typedef struct _chan_meta_t {
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
     chan_diag_t diag;
 #endif // LIBCHAIN_ENABLE_DIAGNOSTICS
-} chan_meta_t;
+} LIBCHAIN_META_ALIGN chan_meta_t;
 
 typedef struct _var_meta_t {
     chain_time_t timestamp;
-} var_meta_t;
+} LIBCHAIN_META_ALIGN var_meta_t;
+
+/** @brief Capacity of the table of the timestamps that have been written
+ *  @details Timestamps are compared by their age, i.e. by their distance
+ *           from the current logical time, which is exact as long as
+ *           no age wraps around. A sweep visits one entry of the table every
+ *           LIBCHAIN_STAMP_SWEEP_INTERVAL transitions (a power of 2), and
+ *           records the full logical time of a timestamp while it is
+ *           younger than CHAIN_TIME_HORIZON, or rewrites it to keep its age
+ *           within the horizon once it is older. Timestamps older than the
+ *           horizon are ordered by the recorded time, on a slow path.
+ *
+ *           A pass of the sweep takes (LIBCHAIN_STAMPS + 1) intervals, since
+ *           it also expires the times kept by the runtime and applies the
+ *           pending redo logs, whose timestamps reach the table up to a pass
+ *           late. So, a pass must take less than half the horizon, 0x5000
+ *           transitions: by default, the interval shrinks as the table grows.
+ *
+ *           Each element of an array field, each block of a block-versioned
+ *           field, and each of the two buffers of a self-channel field takes
+ *           an entry once it is written. An application that writes more
+ *           variables stops with an error, on the first write that does not
+ *           fit.
+ */
+#ifndef LIBCHAIN_STAMPS
+#define LIBCHAIN_STAMPS 256 // power of 2, for the default interval
+#endif
+
+#ifndef LIBCHAIN_STAMP_SWEEP_INTERVAL
+#define LIBCHAIN_STAMP_SWEEP_INTERVAL (0x4000 / LIBCHAIN_STAMPS) // transitions
+#endif
+
+/** @brief Age beyond which timestamps are ordered by the slow path */
+#define CHAIN_TIME_HORIZON ((chain_time_t)0xa000)
+
+/** @brief Age of a value that was never written, older than any other */
+#define CHAIN_TIME_NEVER ((chain_time_t)-1)
+
+/* Internal: the logical time of the current context, kept in volatile memory */
+extern chain_time_t chain_now;
+
+/* Internal: timestamps, see LIBCHAIN_STAMPS */
+void chain_stamp_register(var_meta_t *var);
+int chain_stamp_newer_slow(const var_meta_t *var, const var_meta_t *than);
+
+/** @brief Stamp a variable with the current logical time (internal) */
+static inline void chain_stamp(var_meta_t *var)
+{
+    if (!var->timestamp)
+        chain_stamp_register(var);
+    var->timestamp = chain_now;
+}
+
+/** @brief Age of a timestamp (internal) */
+static inline chain_time_t chain_stamp_age(chain_time_t timestamp)
+{
+    return timestamp ? (chain_time_t)(chain_now - timestamp) : CHAIN_TIME_NEVER;
+}
+
+/** @brief Whether a variable was written after the latest one so far (internal)
+ *  @param latest   latest variable so far, or NULL (with age CHAIN_TIME_NEVER)
+ *  @details Only two variables that were both written before the horizon
+ *           take the slow path.
+ */
+static inline int chain_stamp_newer(const var_meta_t *var, chain_time_t age,
+                                    const var_meta_t *latest, chain_time_t latest_age)
+{
+    if (age >= CHAIN_TIME_HORIZON && latest_age >= CHAIN_TIME_HORIZON) {
+        if (latest_age == CHAIN_TIME_NEVER)
+            return age != CHAIN_TIME_NEVER;
+        return chain_stamp_newer_slow(var, latest);
+    }
+    return age < latest_age;
+}
+
+/** @brief Latest writer of a field of a destination task
+ *  @details Points to the variable in the channel that was written most
+ *           recently among all channels into the destination task that
+ *           carry the field, so that reading the field does not need to
+ *           compare the timestamps in all those channels.
+ */
+typedef struct _join_field_t {
+    var_meta_t *var;
+} join_field_t;
 
 typedef struct _self_field_meta_t {
     // Single word (two bytes) value that contains
     // * bit 0: dirty bit (i.e. swap needed)
     // * bit 1: index of the current var buffer from the double buffer pair
+    // * bit 2: the value in the next buffer belongs to the latest checkpoint
     // * bit 5: index of the next var buffer from the double buffer pair
     // This layout is so that we can swap the bytes to flip between buffers and
     // at the same time (atomically) clear the dirty bit.  The dirty bit must
     // be reset in bit 4 before the next swap.
     unsigned idx_pair;
-} self_field_meta_t;
+} LIBCHAIN_META_ALIGN self_field_meta_t;
+
+/** @brief Redo log of the writes of a task into its redo-log self-channel
+ *  @details Entries are appended by chan_out and applied to the channel by
+ *           the prologue of the next execution of the task after a
+ *           transition, or discarded by it after a restart.
+ */
+typedef struct _self_log_t {
+    uint8_t *data;
+    unsigned size;
+    volatile unsigned used;
+} self_log_t;
+
+/** @brief Header of an entry in a redo log, followed by the variable */
+typedef struct _self_log_entry_t {
+    var_meta_t *var;
+    size_t var_size;
+} LIBCHAIN_META_ALIGN self_log_entry_t;
+
+/** @brief Performance counters of a task
+ *  @details Maintained only if LIBCHAIN_ENABLE_COUNTERS is defined. The
+ *           counters are not updated atomically with the events that they
+ *           count, so a power failure can make a counter miss an event. On
+ *           MSP430, a counter is updated by two word writes, so a power
+ *           failure between them, when the low word carries, makes the
+ *           counter 65536 short. The counters are estimates, not exact
+ *           counts.
+ */
+typedef struct _chain_counters_t {
+    uint32_t executions;    // executions that transitioned to another task
+    uint32_t restarts;      // executions restarted after a power failure
+    uint32_t swaps;         // self-channel buffer swaps and redo log entries applied
+    uint32_t bytes_written; // value bytes written into channels, per channel
+} chain_counters_t;
+
+#ifdef LIBCHAIN_ENABLE_PROFILE
+
+#ifndef LIBCHAIN_PROFILE_SITES
+#define LIBCHAIN_PROFILE_SITES 32 // call sites of chan_in and chan_out
+#endif
+
+#ifndef LIBCHAIN_PROFILE_TIMER
+#define LIBCHAIN_PROFILE_TIMER 1 // Timer A instance on MSP430
+#endif
 
-typedef struct {
+#define CHAIN_PROFILE_MAGIC 0xC4A2
+
+/** @brief Cost profile of the executions of a task
+ *  @details An execution spans from the end of the prologue to the start of
+ *           the transition. Cycles spent in the transition and in the
+ *           prologue of the next task are the overhead of the execution.
+ *           NV accesses are counted only on the host, while counting is
+ *           enabled (see chain_host_count_nv). The layout is the same on
+ *           all targets (no padding), as for trace records.
+ */
+typedef struct _chain_profile_task_t {
+    uint64_t total_cycles;      // of completed executions
+    uint64_t total_overhead;    // cycles in transitions out of the task
+    uint64_t total_nv_reads;
+    uint64_t total_nv_writes;
+    uint32_t attempts;          // executions started, restarts included
+    uint32_t runs;              // executions completed
+    uint32_t max_cycles;
+    uint32_t max_nv_reads;
+    uint32_t max_nv_writes;
+    uint32_t reserved;
+} chain_profile_task_t;
+
+/** @brief Cost profile of the calls to chan_in or chan_out from one site */
+typedef struct _chain_profile_site_t {
+    uint64_t total_cycles;
+    uint64_t total_nv_reads;
+    uint64_t total_nv_writes;
+    uint64_t total_offset;      // cycles into the execution of the task at the call
+    uint32_t addr;              // return address of the call
+    uint32_t kind;              // 0: chan_in, 1: chan_out
+    uint32_t calls;
+    uint32_t max_cycles;
+} chain_profile_site_t;
+
+/** @brief Table of call sites in non-volatile memory */
+typedef struct _chain_profile_t {
+    uint16_t magic;
+    uint16_t site_size;
+    uint16_t capacity;
+    volatile uint16_t num_sites;
+    uint32_t dropped;           // calls from sites that did not fit
+    uint32_t reserved;
+    chain_profile_site_t sites[LIBCHAIN_PROFILE_SITES];
+} chain_profile_t;
+
+extern chain_profile_t chain_profile;
+
+#endif // LIBCHAIN_ENABLE_PROFILE
+
+/** @brief Slot of an intra-task checkpoint */
+typedef struct _checkpoint_slot_t {
+    volatile chain_time_t time;     // logical time of the execution that took it
+    unsigned num_dirty_self_fields; // self-channel writes made before it
+    unsigned self_log_used;         // redo log entries made before it
+    volatile unsigned undo_used;    // undo log entries made after it
+} checkpoint_slot_t;
+
+/** @brief Intra-task checkpoint storage of a task (see CHECKPOINT)
+ *  @details Double-buffered: a checkpoint is written into the slot that does
+ *           not hold the latest one, and the single-word write of the slot
+ *           index commits it. The undo log holds the staged values of the
+ *           self-channel fields that the latest checkpoint kept and that
+ *           were written again after it, so that a restart restores them.
+ */
+typedef struct _checkpoint_t {
+    uint8_t *data;          // two copies of the progress state
+    unsigned size;          // of one copy
+    uint8_t *undo;
+    unsigned undo_size;
+    volatile unsigned slot; // slot of the latest checkpoint
+    checkpoint_slot_t slots[2];
+} checkpoint_t;
+
+/** @brief Header of an entry in an undo log, followed by the saved variable */
+typedef struct _checkpoint_undo_entry_t {
+    self_field_meta_t *self_field;
+    var_meta_t *var;
+    size_t var_size;
+} LIBCHAIN_META_ALIGN checkpoint_undo_entry_t;
+
+/** @brief One end of a FIFO channel, owned by the task at that end
+ *  @details The operations of an execution of the owner advance the staged
+ *           position. The staged position becomes the committed one when
+ *           the execution transitions, which is detected lazily from the
+ *           logical time of the execution that staged it (as for the
+ *           buffers of self-channels). A restart discards it.
+ */
+typedef struct _fifo_end_t {
+    volatile unsigned pos;      // committed position
+    volatile unsigned staged;   // position after the operations of the execution
+    volatile chain_time_t time; // logical time of that execution
+    volatile unsigned checkpoint[2]; // staged position saved by each checkpoint slot
+} fifo_end_t;
+
+/** @brief FIFO channel (see FIFO_CHANNEL)
+ *  @details Positions run over twice the capacity, to tell a full FIFO
+ *           from an empty one.
+ */
+typedef struct _fifo_t {
+    chan_meta_t meta;
+    uint8_t *data;
+    unsigned elem_size;
+    unsigned capacity;          // in elements
+    const struct _task_t *producer;
+    const struct _task_t *consumer;
+    fifo_end_t head;            // owned by the consumer
+    fifo_end_t tail;            // owned by the producer
+} fifo_t;
+
+/** @brief Header that precedes a volatile channel (see VOLATILE_CHANNEL)
+ *  @details Both live in volatile memory. The size is a multiple of the
+ *           metadata alignment, so the channel follows the header directly.
+ */
+typedef struct _volatile_chan_meta_t {
+    unsigned epoch;             // boot in which the channel was written, 0: never
+    const struct _task_t *regen; // task that regenerates the contents, or NULL
+} LIBCHAIN_META_ALIGN volatile_chan_meta_t;
+
+/** @brief An event, posted by an interrupt handler (see EVENT_POST) */
+typedef struct _chain_event_t {
+    unsigned type;
+    unsigned data;              // payload, meaning defined by the type
+} chain_event_t;
+
+/** @brief Registration of the task that handles a type of event (see EVENT_HANDLER) */
+typedef struct _event_handler_t {
+    unsigned type;
+    const struct _task_t *task;
+} event_handler_t;
+
+/** @brief Runtime state of a task, in non-volatile memory */
+typedef struct _task_state_t {
+    volatile unsigned num_dirty_self_fields; // length of the dirty list
+    volatile unsigned batch; // iterations per execution of a BATCH_LOOP
+} task_state_t;
+
+/** @brief Descriptor of a task
+ *  @details Immutable, so it is kept in read-only memory, in the task table
+ *           (see TASK). Everything that changes at runtime is in the state.
+ */
+typedef struct _task_t {
     task_func_t *func;
-    task_mask_t mask;
-    task_idx_t idx;
+    task_state_t *state;
 
     // Dirty self channel fields are ones to which there had been a
     // chan_out. The out value is "staged" in the alternate buffer of
     // the self-channel double-buffer pair for each field. On transition,
     // the buffer index is flipped for dirty fields.
-    self_field_meta_t *dirty_self_fields[MAX_DIRTY_SELF_FIELDS];
-    volatile unsigned num_dirty_self_fields;
+    //
+    // Each field is listed at most once, so the list is sized by the
+    // number of fields in the self-channel of the task (see SELF_CHANNEL).
+    self_field_meta_t **dirty_self_fields;
 
-    volatile chain_time_t last_execute_time; // to execute prologue only once
+    self_log_t *self_log; // writes into the redo-log self-channel
+
+    checkpoint_t *checkpoint; // progress within an execution
+
+#ifdef LIBCHAIN_ENABLE_COUNTERS
+    chain_counters_t *counters;
+#endif // LIBCHAIN_ENABLE_COUNTERS
+
+#ifdef LIBCHAIN_ENABLE_PROFILE
+    chain_profile_task_t *profile;
+#endif // LIBCHAIN_ENABLE_PROFILE
 
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
-    char name[TASK_NAME_SIZE];
+    const char *name;
 #endif // LIBCHAIN_ENABLE_DIAGNOSTICS
 } task_t;
 
@@ -82,6 +385,8 @@ typedef struct {
 #define SELF_CHAN_IDX_BIT_DIRTY_NEXT     0x0100U
 #define SELF_CHAN_IDX_BIT_CURRENT        0x0002U
 #define SELF_CHAN_IDX_BIT_NEXT           0x0200U
+#define SELF_CHAN_IDX_BIT_CHECKPOINT_CURRENT 0x0004U
+#define SELF_CHAN_IDX_BIT_CHECKPOINT_NEXT    0x0400U
 
 #define VAR_TYPE(type) \
     struct { \
@@ -89,6 +394,16 @@ typedef struct {
         type value; \
     } \
 
+/** @brief Size of the 'variable' type (var_meta_t + value type)
+ *  @details C++ does not allow defining types inside sizeof, so there
+ *           the size is taken of an equivalent named template.
+ */
+#ifdef __cplusplus
+#define VAR_SIZE(type) sizeof(_chain_var_type<type>)
+#else // !__cplusplus
+#define VAR_SIZE(type) sizeof(VAR_TYPE(type))
+#endif // !__cplusplus
+
 #define FIELD_TYPE(type) \
     struct { \
         VAR_TYPE(type) var; \
@@ -100,6 +415,16 @@ typedef struct {
         VAR_TYPE(type) var[2]; \
     }
 
+/** @brief Array of values versioned by blocks of values, not by values
+ *  @details The timestamps are stored separately from the values, so that
+ *           the values are contiguous and can be transferred in bulk.
+ */
+#define BLOCKS_FIELD_TYPE(type, size, block) \
+    struct { \
+        var_meta_t meta[(size) / (block)]; \
+        type value[size]; \
+    }
+
 #define CH_TYPE(src, dest, type) \
     struct _ch_type_ ## src ## _ ## dest ## _ ## type { \
         chan_meta_t meta; \
@@ -124,24 +449,145 @@ typedef struct {
 #define SELF_CHAN_FIELD(type, name)             SELF_FIELD_TYPE(type) name
 #define SELF_CHAN_FIELD_ARRAY(type, name, size) SELF_FIELD_TYPE(type) name[size]
 
-/** @brief Execution context */
-typedef struct _context_t {
-    /** @brief Pointer to the most recently started but not finished task */
-    task_t *task;
+/** @brief Declare an array field in a self-channel that is double-buffered as a whole
+ *  @details A SELF_CHAN_FIELD_ARRAY is double-buffered element by element, so
+ *           writing the whole array costs one swap per element on
+ *           transition. This field has one index pair for the whole array,
+ *           so it is flipped by a single swap. It is accessed as a single
+ *           value of the array type, so declare a name for that type:
+ *
+ *               typedef type array_type[size];
+ *               array_type *p = CHAN_IN1(array_type, name, SELF_IN_CH(task));
+ *               CHAN_OUT1(array_type, name, array, SELF_OUT_CH(task));
+ *
+ *           Any element not written by the task is carried over from the
+ *           previous version only if the task writes the whole array, so
+ *           for partial updates use CHAN_OUT_BEGIN, copy the current value,
+ *           and modify it in place.
+ */
+#define SELF_CHAN_FIELD_BUFFER(type, name, size) \
+    SELF_FIELD_TYPE(__typeof__(type[size])) name
+
+/** @brief Declare an array field with one timestamp per block of elements
+ *  @param  size    Number of elements, must be a multiple of block
+ *  @param  block   Number of elements that share a timestamp
+ *  @details A CHAN_FIELD_ARRAY carries a timestamp with each element and is
+ *           accessed one element at a time. This field carries a timestamp
+ *           per block (CHAN_FIELD_BLOCKS) or one for the whole array
+ *           (CHAN_FIELD_BUFFER), and is accessed in ranges of elements
+ *           with CHAN_IN_RANGE*, CHAN_OUT_RANGE*, and CHAN_IN_BLOCK*.
+ *           A block is versioned as a whole: after a write to part of a
+ *           block, reads of the rest of the block return the values that
+ *           the same channel held before. Not supported in self-channels.
+ */
+#define CHAN_FIELD_BLOCKS(type, name, size, block) BLOCKS_FIELD_TYPE(type, size, block) name
+#define CHAN_FIELD_BUFFER(type, name, size)        BLOCKS_FIELD_TYPE(type, size, size) name
+
+#ifdef LIBCHAIN_ENABLE_TRACE
+
+#ifndef LIBCHAIN_TRACE_SIZE
+#define LIBCHAIN_TRACE_SIZE 64 // records
+#endif
+
+#define CHAIN_TRACE_MAGIC 0xC4A1
+
+typedef enum {
+    CHAIN_TRACE_BOOT,       // task: the current task
+    CHAIN_TRACE_RESTART,    // task: the restarted task
+    CHAIN_TRACE_TRANSITION, // task: the next task
+    CHAIN_TRACE_IN,         // chan: the channel with the latest value
+                            // (for a FIFO, field: the elements popped)
+    CHAIN_TRACE_OUT,        // chan: the written channel
+                            // (for a FIFO, field: the elements pushed)
+    CHAIN_TRACE_CHECKPOINT, // field: the slot
+} chain_trace_kind_t;
 
+/** @brief Trace record
+ *  @details The layout is the same on all targets (no padding), so that
+ *           traces can be decoded without knowing the target. Tasks and
+ *           channels are identified by address, and resolved to names by
+ *           the decoder from the symbol table of the application binary.
+ */
+typedef struct _chain_trace_rec_t {
+    uint32_t task;
+    uint32_t chan;
+    uint16_t time;  // logical time, truncated
+    uint16_t boot;  // boot count, truncated
+    uint16_t field; // offset of the field in the message type of the channel
+    uint16_t kind;
+} chain_trace_rec_t;
+
+/** @brief Ring buffer of trace records in non-volatile memory */
+typedef struct _chain_trace_t {
+    uint16_t magic;
+    uint16_t rec_size;
+    uint16_t capacity;
+    volatile uint16_t next;
+    volatile uint16_t wrapped;
+    uint16_t reserved;
+    chain_trace_rec_t recs[LIBCHAIN_TRACE_SIZE];
+} chain_trace_t;
+
+extern chain_trace_t chain_trace;
+
+#endif // LIBCHAIN_ENABLE_TRACE
+
+/** @brief Flag of the task word of a context: the prologue of the task,
+ *         which applies its self-channel writes, has not completed
+ */
+#define CONTEXT_PROLOGUE 0x8000u
+
+/** @brief Task word of the initial context, for the entry task (whose
+ *         position in the task table is known only at link time)
+ */
+#define CONTEXT_ENTRY_TASK (CONTEXT_PROLOGUE - 1)
+
+/** @brief Execution context
+ *  @details The context is double-buffered in two slots, which alternate:
+ *           the current context is the one whose time follows the time in
+ *           the other slot. A transition writes the task word and then the
+ *           time into the other slot, and the single-word write of the time
+ *           commits it. The call depth and the era are written only when
+ *           they differ from what the slot holds.
+ */
+typedef struct _context_t {
     /** @brief Logical time, ticks at task boundaries */
     chain_time_t time;
 
-    // TODO: move this to top, just feels cleaner
-    struct _context_t *next_ctx;
+    /** @brief Position in the task table of the most recently started but
+     *         not finished task, with CONTEXT_PROLOGUE
+     */
+    task_idx_t task;
+
+    /** @brief Number of entries in the call stack (see TRANSITION_CALL) */
+    unsigned call_depth;
+
+    /** @brief Number of times that the logical time wrapped around */
+    uint32_t era;
 } context_t;
 
+/** @brief Pointer to the current context slot
+ *  @details Derived from the slots on boot and kept in volatile memory.
+ */
 extern context_t * volatile curctx;
 
+/** @brief Task of the current context, kept in volatile memory */
+extern const task_t *chain_task;
+
 /** @brief Internal macro for constructing name of task symbol */
 #define TASK_SYM_NAME(func) _task_ ## func
 
-#define TASK_REF(func) &TASK_SYM_NAME(func)
+/** @brief Internal macro for the name of the runtime state of a task */
+#define TASK_STATE_SYM_NAME(func) _task_state_ ## func
+
+/** @brief Internal macro for the name of the dirty self-field list of a task */
+#define DIRTY_SELF_FIELDS_SYM_NAME(func) _dirty_self_fields_ ## func
+
+/** @brief Internal macro for the name of the redo log of a task */
+#define SELF_LOG_SYM_NAME(func) _self_log_ ## func
+
+/** @brief Internal macro for the name of the checkpoint storage of a task */
+#define CHECKPOINT_SYM_NAME(func) _checkpoint_ ## func
 
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
 #define TASK_DIAG_FIELDS(func) , #func
@@ -151,26 +597,77 @@ extern context_t * volatile curctx;
 #define CHAN_DIAG_FIELDS(src, prefix, dest)
 #endif // !LIBCHAIN_ENABLE_DIAGNOSTICS
 
+/** @brief Internal macro for the name of the counters of a task */
+#define TASK_COUNTERS_SYM_NAME(func) _task_counters_ ## func
+
+#ifdef LIBCHAIN_ENABLE_COUNTERS
+#define TASK_COUNTERS_DECL(func) __nv chain_counters_t TASK_COUNTERS_SYM_NAME(func);
+#define TASK_COUNTERS_FIELDS(func) , &TASK_COUNTERS_SYM_NAME(func)
+#else // !LIBCHAIN_ENABLE_COUNTERS
+#define TASK_COUNTERS_DECL(func)
+#define TASK_COUNTERS_FIELDS(func)
+#endif // !LIBCHAIN_ENABLE_COUNTERS
+
+/** @brief Internal macro for the name of the cost profile of a task */
+#define TASK_PROFILE_SYM_NAME(func) _task_profile_ ## func
+
+#ifdef LIBCHAIN_ENABLE_PROFILE
+#define TASK_PROFILE_DECL(func) __nv chain_profile_task_t TASK_PROFILE_SYM_NAME(func);
+#define TASK_PROFILE_FIELDS(func) , &TASK_PROFILE_SYM_NAME(func)
+#else // !LIBCHAIN_ENABLE_PROFILE
+#define TASK_PROFILE_DECL(func)
+#define TASK_PROFILE_FIELDS(func)
+#endif // !LIBCHAIN_ENABLE_PROFILE
+
+/** @brief Internal macro for placing a task descriptor into the task table
+ *  @details All descriptors go into one section, which the linker
+ *           concatenates into a dense array. The explicit alignment keeps
+ *           the compiler from over-aligning the descriptors (as it does
+ *           for larger objects on x86-64), which would leave gaps.
+ */
+#define TASK_TABLE_ATTR \
+    __attribute__((section("chain_tasks"), used, aligned(__alignof__(task_t))))
+
+/** @brief Bounds of the task table (provided by the linker) */
+extern const task_t __start_chain_tasks[];
+extern const task_t __stop_chain_tasks[];
+
 /** @brief Declare a task
  *
- *  @param idx      Global task index, zero-based
+ *  @param idx      Task number, kept for compatibility: tasks are numbered
+ *                  by their position in the task table (see TASK_IDX)
  *  @param func     Pointer to task function
  *
- *   TODO: These do not need to be stored in memory, could be resolved
- *         into literal values and encoded directly in the code instructions.
- *         But, it's not obvious how to implement that with macros (would
- *         need "define inside a define"), so for now create symbols.
- *         The compiler should actually optimize these away.
- *
- *   TODO: Consider creating a table in form of struct and store
- *         for each task: mask, index, name. That way we can
- *         have access to task name for diagnostic output.
+ *  The descriptor of the task is constant and goes into the task table in
+ *  read-only memory. Only the state of the task is in non-volatile memory.
+ *  The number of tasks is not limited.
  */
 #define TASK(idx, func) \
     void func(); \
-    __nv task_t TASK_SYM_NAME(func) = { func, (1UL << idx), idx, {0}, 0, 0, TASK_DIAG_FIELDS(func) }; \
+    extern self_field_meta_t *DIRTY_SELF_FIELDS_SYM_NAME(func)[] __attribute__((weak)); \
+    extern self_log_t SELF_LOG_SYM_NAME(func) __attribute__((weak)); \
+    extern checkpoint_t CHECKPOINT_SYM_NAME(func) __attribute__((weak)); \
+    TASK_COUNTERS_DECL(func) \
+    TASK_PROFILE_DECL(func) \
+    __nv task_state_t TASK_STATE_SYM_NAME(func) = { 0, 1 }; \
+    extern const task_t TASK_SYM_NAME(func); \
+    const task_t TASK_SYM_NAME(func) TASK_TABLE_ATTR = { func, \
+        &TASK_STATE_SYM_NAME(func), DIRTY_SELF_FIELDS_SYM_NAME(func), \
+        &SELF_LOG_SYM_NAME(func), &CHECKPOINT_SYM_NAME(func) \
+        TASK_COUNTERS_FIELDS(func) TASK_PROFILE_FIELDS(func) TASK_DIAG_FIELDS(func) }; \
+
+#define TASK_REF(func) (&TASK_SYM_NAME(func))
+
+/** @brief Number of tasks in the application, including the entry task */
+#define TASK_COUNT ((task_idx_t)(__stop_chain_tasks - __start_chain_tasks))
 
-#define TASK_REF(func) &TASK_SYM_NAME(func)
+/** @brief Position of a task in the task table */
+#define TASK_IDX(func) ((task_idx_t)(TASK_REF(func) - __start_chain_tasks))
+
+/** @brief Task at a position in the task table, e.g. to transition to a
+ *         task chosen at runtime: transition_to(TASK_AT(i))
+ */
+#define TASK_AT(idx) (&__start_chain_tasks[idx])
 
 /** @brief Function called on every reboot
  *  @details This function usually initializes hardware, such as GPIO
@@ -190,7 +687,7 @@ extern void init();
  *        not constrained, and the whole thing is less magical when reading app
  *        code, but slightly more verbose.
  */
-extern task_t TASK_SYM_NAME(_entry_task);
+extern const task_t TASK_SYM_NAME(_entry_task);
 
 /** @brief Declare the first task of the application
  *  @details This macro defines a function with a special name that is
@@ -212,11 +709,95 @@ extern task_t TASK_SYM_NAME(_entry_task);
  */
 int chain_main();
 
+#if defined(LIBCHAIN_ENABLE_ENTRY) && !defined(LIBCHAIN_HOST)
+/** @brief Reset entry point of the runtime, in place of crt0 and main (MSP430)
+ *  @details With LIBCHAIN_ENABLE_ENTRY, the library puts this function into
+ *           the reset vector, and the application is linked without the
+ *           startup files (-nostartfiles -Wl,-e,chain_start). On reset, it
+ *           sets up the stack, holds the watchdog, initializes .data and
+ *           .bss (skipping the copy of .data when it runs where it is
+ *           loaded), calls init() and branches to the task to resume, so
+ *           main is not called. Constructors (.init_array) are not run, nor
+ *           are the sections of the upper memory region (-mlarge) set up:
+ *           applications that rely on either must use chain_main.
+ *
+ *           On the host, the backend is the entry point on every reboot
+ *           (see host.h), and this option has no effect.
+ */
+void chain_start() __attribute__((noreturn));
+
+/** @brief Optional hook that the application may define, called by chain_start
+ *  @details Called right after reset, before memory is initialized, so it
+ *           must not rely on the value of any variable outside FRAM. Meant
+ *           for configuring the clock to shorten the rest of the boot.
+ */
+void chain_start_early();
+#endif // LIBCHAIN_ENABLE_ENTRY && !LIBCHAIN_HOST
+
+/** @brief Get the performance counters of a task (zero if not enabled) */
+void chain_counters_get(const task_t *task, chain_counters_t *counters);
+
+/** @brief Reset the performance counters of a task */
+void chain_counters_reset(const task_t *task);
+
+#ifdef LIBCHAIN_ENABLE_PROFILE
+/** @brief Print the cost profile as hex dump lines of "address bytes"
+ *  @details For targets whose memory cannot be imaged, e.g. a simulator:
+ *           tools/chain-profile decodes the output (see --dump).
+ */
+void chain_profile_dump();
+#endif // LIBCHAIN_ENABLE_PROFILE
+
+#ifdef LIBCHAIN_ENABLE_CACHE
+/** @brief Number of fields that the channel cache holds per task execution */
+#ifndef LIBCHAIN_CACHE_ENTRIES
+#define LIBCHAIN_CACHE_ENTRIES 16
+#endif
+
+/** @brief Bytes of values that the channel cache holds per task execution */
+#ifndef LIBCHAIN_CACHE_SIZE
+#define LIBCHAIN_CACHE_SIZE 256
+#endif
+
+/** @brief Channels in a CHAN_IN that the channel cache remembers the result of */
+#ifndef LIBCHAIN_CACHE_MAX_CHANS
+#define LIBCHAIN_CACHE_MAX_CHANS 4
+#endif
+#endif // LIBCHAIN_ENABLE_CACHE
+
 void task_prologue();
-void transition_to(task_t *task);
+void transition_to(const task_t *task);
 void *chan_in(const char *field_name, size_t var_size, int count, ...);
 void chan_out(const char *field_name, const void *value,
               size_t var_size, int count, ...);
+void *chan_out_begin(size_t var_size, void *chan, size_t field_offset);
+void chan_out_commit(const char *field_name, size_t var_size,
+                     void *chan, size_t field_offset);
+void *chan_in_block(const char *field_name, unsigned block, size_t block_size,
+                    size_t value_offset, int count, ...);
+void chan_in_range(const char *field_name, void *dest, size_t start, size_t size,
+                   size_t block_size, size_t value_offset, int count, ...);
+void chan_out_range(const char *field_name, const void *src, size_t start, size_t size,
+                    size_t block_size, size_t value_offset, int count, ...);
+void *chan_in_join(const char *field_name, size_t var_size, join_field_t *join,
+                   void *self_chan, size_t field_offset);
+void chan_out_join(const char *field_name, const void *value, size_t var_size,
+                   void *chan, size_t field_offset, int count, ...);
+
+/** @brief Whether the library acts on each channel access (internal)
+ *  @details Set when the library is built with the channel cache, the
+ *           diagnostics, the trace or the profile, whose work is done by
+ *           chan_in and chan_out: the C++ front end (chain.hpp) then goes
+ *           through them. The application is not necessarily compiled with
+ *           the options of the library, hence the variable.
+ */
+#if defined(LIBCHAIN_ENABLE_CACHE) || defined(LIBCHAIN_ENABLE_DIAGNOSTICS) || \
+    defined(LIBCHAIN_ENABLE_TRACE) || defined(LIBCHAIN_ENABLE_PROFILE)
+#define CHAIN_CHAN_HOOKS 1
+#else
+#define CHAIN_CHAN_HOOKS 0
+#endif
+extern const int chain_chan_hooks;
 
 #define FIELD_COUNT_INNER(type) NUM_FIELDS_ ## type
 #define FIELD_COUNT(type) FIELD_COUNT_INNER(type)
@@ -238,17 +819,89 @@ void chan_out(const char *field_name, const void *value,
 #define SELF_FIELDS_INITIALIZER_INNER(type) FIELD_INIT_ ## type
 #define SELF_FIELDS_INITIALIZER(type) SELF_FIELDS_INITIALIZER_INNER(type)
 
+/** @brief Internal: record the kind of a channel for the C++ front end
+ *  @details For the kinds that it does not access like a task-to-task channel
+ *           (see chain.hpp), declared by SELF_CHANNEL, SELF_LOG_CHANNEL and
+ *           VOLATILE_CHANNEL. Follows the declaration of the channel.
+ */
+#ifdef __cplusplus
+#define CHAN_KIND_MARK(chan, kind) ; \
+    template <> struct _chain_chan_kind<decltype(chan)> { \
+        static const int value = kind; \
+    }
+#else // !__cplusplus
+#define CHAN_KIND_MARK(chan, kind)
+#endif // !__cplusplus
+
 #define CHANNEL(src, dest, type) \
     __nv CH_TYPE(src, dest, type) _ch_ ## src ## _ ## dest = \
         { { CHAN_TYPE_T2T CHAN_DIAG_FIELDS(src, "", dest) } }
 
+/** @brief Upper bound on the number of fields in a self-channel message type
+ *  @details Every field takes at least its metadata and two timestamps.
+ */
+#define MAX_SELF_FIELDS(type) \
+    (sizeof(struct type) / (sizeof(self_field_meta_t) + 2 * sizeof(var_meta_t)))
+
+/** @brief Declare the self-channel of a task
+ *  @details Also defines the list of dirty fields of the task, which the
+ *           task references weakly (a task without a self-channel has none).
+ */
 #define SELF_CHANNEL(task, type) \
+    __nv self_field_meta_t *DIRTY_SELF_FIELDS_SYM_NAME(task)[MAX_SELF_FIELDS(type)]; \
+    __nv CH_TYPE(task, task, type) _ch_ ## task ## _ ## task = \
+        { { CHAN_TYPE_SELF CHAN_DIAG_FIELDS(task, "", task) }, SELF_FIELDS_INITIALIZER(type) } \
+    CHAN_KIND_MARK(_ch_ ## task ## _ ## task, CHAN_TYPE_SELF)
+
+/** @brief Space taken in a redo log by one write of a value of the given type */
+#define SELF_LOG_ENTRY_SIZE(type) \
+    (sizeof(self_log_entry_t) + \
+     ((VAR_SIZE(type) + sizeof(var_meta_t) - 1) / sizeof(var_meta_t)) * sizeof(var_meta_t))
+
+/** @brief Declare the self-channel of a task with a redo log instead of double buffers
+ *  @param  log_size    Capacity of the log in bytes, see SELF_LOG_ENTRY_SIZE
+ *  @details The fields are declared with CHAN_FIELD and CHAN_FIELD_ARRAY and
+ *           hold a single copy of the values. Writes by the task are
+ *           appended to the log, and applied to the channel on transition,
+ *           so memory and commit cost depend on the amount of data written
+ *           per execution, not on the size of the channel. The log must fit
+ *           all writes of one execution of the task: an overflow is fatal.
+ *
+ *           A task has either a SELF_CHANNEL or a SELF_LOG_CHANNEL, which is
+ *           referred to with SELF_IN_CH/SELF_OUT_CH just the same.
+ */
+#define SELF_LOG_CHANNEL(task, type, log_size) \
+    __nv var_meta_t _self_log_data_ ## task[((log_size) + sizeof(var_meta_t) - 1) / sizeof(var_meta_t)]; \
+    __nv self_log_t SELF_LOG_SYM_NAME(task) = \
+        { (uint8_t *)_self_log_data_ ## task, sizeof(_self_log_data_ ## task), 0 }; \
     __nv CH_TYPE(task, task, type) _ch_ ## task ## _ ## task = \
-        { { CHAN_TYPE_SELF CHAN_DIAG_FIELDS(task, "", task) }, SELF_FIELDS_INITIALIZER(type) }
+        { { CHAN_TYPE_SELF_LOG CHAN_DIAG_FIELDS(task, "log:", task) } } \
+    CHAN_KIND_MARK(_ch_ ## task ## _ ## task, CHAN_TYPE_SELF_LOG)
+
+/** @brief Space taken in an undo log by the saved value of a field of the given type */
+#define CHECKPOINT_UNDO_ENTRY_SIZE(type) \
+    (sizeof(checkpoint_undo_entry_t) + \
+     ((VAR_SIZE(type) + sizeof(var_meta_t) - 1) / sizeof(var_meta_t)) * sizeof(var_meta_t))
+
+/** @brief Declare the storage for intra-task checkpoints of a task
+ *  @param  type        struct that holds the progress state of the task
+ *  @param  undo_size   Capacity of the undo log in bytes, see
+ *                      CHECKPOINT_UNDO_ENTRY_SIZE
+ *  @details See TASK_CHECKPOINT. The task references it weakly. The undo log
+ *           must fit one entry per self-channel field that the task writes
+ *           both before a checkpoint and after it (0 if there are none): an
+ *           overflow is fatal.
+ */
+#define CHECKPOINT(task, type, undo_size) \
+    __nv struct type _checkpoint_data_ ## task[2]; \
+    __nv var_meta_t _checkpoint_undo_ ## task[((undo_size) + sizeof(var_meta_t) - 1) / sizeof(var_meta_t)]; \
+    __nv checkpoint_t CHECKPOINT_SYM_NAME(task) = \
+        { (uint8_t *)_checkpoint_data_ ## task, sizeof(struct type), \
+          (uint8_t *)_checkpoint_undo_ ## task, sizeof(_checkpoint_undo_ ## task) }
 
 /** @brief Declare a channel for passing arguments to a callable task
  *  @details Callers would output values into this channels before
- *           transitioning to the callable task.
+ *           transitioning to the callable task (see TRANSITION_CALL).
  *
  *  TODO: should this be associated with the callee task? i.e. the
  *        'callee' argument would be a task name? The concern is
@@ -259,7 +912,7 @@ void chan_out(const char *field_name, const void *value,
     __nv CH_TYPE(caller, callee, type) _ch_call_ ## callee = \
         { { CHAN_TYPE_CALL CHAN_DIAG_FIELDS(callee, "call:", callee) } }
 #define RET_CHANNEL(callee, type) \
-    __nv CH_TYPE(caller, callee, type) _ch_ret_ ## callee = \
+    __nv CH_TYPE(callee, caller, type) _ch_ret_ ## callee = \
         { { CHAN_TYPE_RETURN CHAN_DIAG_FIELDS(callee, "ret:", callee) } }
 
 /** @brief Delcare a channel for receiving results from a callable task
@@ -270,7 +923,7 @@ void chan_out(const char *field_name, const void *value,
  *           before the next call to the same task is made.
  */
 #define RETURN_CHANNEL(callee, type) \
-    __nv CH_TYPE(caller, callee, type) _ch_ret_ ## callee = \
+    __nv CH_TYPE(callee, caller, type) _ch_ret_ ## callee = \
         { { CHAN_TYPE_RETURN CHAN_DIAG_FIELDS(callee, "ret:", callee) } }
 
 /** @brief Declare a multicast channel: one source many destinations
@@ -286,9 +939,76 @@ void chan_out(const char *field_name, const void *value,
     __nv CH_TYPE(src, name, type) _ch_mc_ ## src ## _ ## name = \
         { { CHAN_TYPE_MULTICAST CHAN_DIAG_FIELDS(src, "mc:", name) } }
 
+/** @brief Internal macro for registering a FIFO channel
+ *  @details A task that restarts discards the operations of the incomplete
+ *           execution on the FIFOs that it owns an end of, which it finds
+ *           in this table (assembled by the linker, like the task table).
+ */
+#define FIFO_TABLE_ATTR __attribute__((section("chain_fifos"), used))
+
+/** @brief Declare a FIFO channel that carries a stream of elements
+ *  @param  type        type of an element
+ *  @param  capacity    number of elements
+ *  @details Elements pushed by the source become visible to the destination,
+ *           and space freed by the pops of the destination becomes
+ *           available to the source, when the task that made the operation
+ *           transitions. The elements carry no metadata.
+ */
+#define FIFO_CHANNEL(src, dest, type, capacity) \
+    __nv type _fifo_data_ ## src ## _ ## dest[capacity]; \
+    __nv fifo_t _ch_fifo_ ## src ## _ ## dest = \
+        { { CHAN_TYPE_FIFO CHAN_DIAG_FIELDS(src, "fifo:", dest) }, \
+          (uint8_t *)_fifo_data_ ## src ## _ ## dest, sizeof(type), capacity, \
+          TASK_REF(src), TASK_REF(dest) }; \
+    fifo_t * const _fifo_ref_ ## src ## _ ## dest FIFO_TABLE_ATTR = \
+        &_ch_fifo_ ## src ## _ ## dest
+
+/** @brief Declare a channel in volatile memory for data that can be recomputed
+ *  @details Accesses cost SRAM accesses instead of FRAM accesses, but the
+ *           contents are lost on power failure. The channel is tagged with
+ *           the boot in which it was last written (the tag is the whole
+ *           channel's, so the writer should write all fields that readers
+ *           need), and from the next boot on, CHAN_IN ignores it as stale.
+ *           The field is then read from the other channels in the list, so
+ *           a task may list an NV channel that carries a copy as fallback:
+ *
+ *               CHAN_IN2(type, x, VOL_CH(task_a, task_b), CH(task_a, task_b))
+ *
+ *           Only CHAN_IN checks the tag: read volatile channels with it.
+ */
+#define VOLATILE_CHANNEL(src, dest, type) \
+    struct { \
+        volatile_chan_meta_t meta; \
+        CH_TYPE(src, vol_ ## dest, type) ch; \
+    } _vch_ ## src ## _ ## dest = \
+        { { 0, NULL }, { { CHAN_TYPE_VOLATILE CHAN_DIAG_FIELDS(src, "vol:", dest) } } } \
+    CHAN_KIND_MARK(_vch_ ## src ## _ ## dest.ch, CHAN_TYPE_VOLATILE)
+
+/** @brief Declare a volatile channel with a task that regenerates its contents
+ *  @details When no channel in the list of a CHAN_IN holds a value because
+ *           this one is stale, the execution of the reading task is
+ *           discarded (as on a restart) and the regeneration task is
+ *           called as with TRANSITION_CALL: it writes the channel and
+ *           ends with TRANSITION_RETURN, which restarts the reading task.
+ */
+#define VOLATILE_CHANNEL_REGEN(src, dest, type, regen) \
+    struct { \
+        volatile_chan_meta_t meta; \
+        CH_TYPE(src, vol_ ## dest, type) ch; \
+    } _vch_ ## src ## _ ## dest = \
+        { { 0, TASK_REF(regen) }, \
+          { { CHAN_TYPE_VOLATILE CHAN_DIAG_FIELDS(src, "vol:", dest) } } } \
+    CHAN_KIND_MARK(_vch_ ## src ## _ ## dest.ch, CHAN_TYPE_VOLATILE)
+
 #define CH(src, dest) (&_ch_ ## src ## _ ## dest)
 #define SELF_CH(tsk)  CH(tsk, tsk)
 
+/** @brief Reference to a FIFO channel */
+#define FIFO_CH(src, dest) (&_ch_fifo_ ## src ## _ ## dest)
+
+/** @brief Reference to a volatile channel */
+#define VOL_CH(src, dest) (&_vch_ ## src ## _ ## dest.ch)
+
 /* For compatibility */
 #define SELF_IN_CH(tsk)  CH(tsk, tsk)
 #define SELF_OUT_CH(tsk) CH(tsk, tsk)
@@ -326,6 +1046,103 @@ void chan_out(const char *field_name, const void *value,
 #define MC_IN_CH(name, src, dest)         (&_ch_mc_ ## src ## _ ## name)
 #define MC_OUT_CH(name, src, dest, ...)   (&_ch_mc_ ## src ## _ ## name)
 
+/** @brief Append up to n elements to a FIFO channel (from the source)
+ *  @return The number of elements appended, limited by the free space
+ */
+#define FIFO_PUSH(chan, elems, n) fifo_push(chan, elems, sizeof(*(elems)), n)
+
+/** @brief Remove up to n elements from a FIFO channel (from the destination)
+ *  @return The number of elements removed, limited by the available ones
+ */
+#define FIFO_POP(chan, elems, n) fifo_pop(chan, elems, sizeof(*(elems)), n)
+
+/** @brief Number of elements that FIFO_POP can remove */
+#define FIFO_COUNT(chan) fifo_count(chan)
+
+/** @brief Number of elements that FIFO_PUSH can append */
+#define FIFO_SPACE(chan) fifo_space(chan)
+
+unsigned fifo_push(fifo_t *fifo, const void *elems, size_t elem_size, unsigned n);
+unsigned fifo_pop(fifo_t *fifo, void *elems, size_t elem_size, unsigned n);
+unsigned fifo_count(fifo_t *fifo);
+unsigned fifo_space(fifo_t *fifo);
+
+/** @brief Number of events that each priority level of the event queue holds
+ *  @details A power of two.
+ */
+#ifndef LIBCHAIN_EVENT_QUEUE_SIZE
+#define LIBCHAIN_EVENT_QUEUE_SIZE 8
+#endif
+
+/** @brief Number of priority levels of the event queue (0 is the most urgent) */
+#ifndef LIBCHAIN_EVENT_PRIORITIES
+#define LIBCHAIN_EVENT_PRIORITIES 2
+#endif
+
+/** @brief Low-power mode entered by EVENT_WAIT (MSP430 status register bits) */
+#ifndef LIBCHAIN_EVENT_LPM_BITS
+#define LIBCHAIN_EVENT_LPM_BITS LPM3_bits
+#endif
+
+/** @brief Internal macro for registering an event handler
+ *  @details The dispatcher looks up the handler of an event in this table
+ *           (assembled by the linker, like the task table).
+ */
+#define EVENT_TABLE_ATTR \
+    __attribute__((section("chain_events"), used, aligned(__alignof__(event_handler_t))))
+
+/** @brief Register a task as the handler of a type of event
+ *  @param  type    an integer constant or an enumerator
+ *  @details The handler may chain to other tasks, and the last task of the
+ *           handler ends it with EVENT_RETURN. Handlers do not nest: events
+ *           posted meanwhile are dispatched after the return, provided that
+ *           the handler returns within 65534 transitions.
+ */
+#define EVENT_HANDLER(type, task) \
+    const event_handler_t _event_handler_ ## task ## _ ## type EVENT_TABLE_ATTR = \
+        { type, TASK_REF(task) }
+
+/** @brief Post an event to the persistent event queue
+ *  @return 0 on success, -1 if the priority is out of range or the queue
+ *          of that priority is full
+ *  @details Meant for interrupt handlers: the event is dispatched at the
+ *           first transition that commits after it is posted, which goes to
+ *           the handler of the event instead of to its destination, and
+ *           the destination runs when the handler returns. Among the queued
+ *           events, the oldest one of the most urgent priority goes first;
+ *           an event that has no handler is dropped. An event posted by task
+ *           code is posted again by each re-execution of the task.
+ */
+#define EVENT_POST(priority, type, data) chain_event_post(priority, type, data)
+
+/** @brief The event being handled, valid in the tasks of its handler */
+#define EVENT_CURRENT() chain_event_current()
+
+/** @brief End the handler of an event: transition to the preempted task */
+#define EVENT_RETURN() chain_event_return()
+
+/** @brief Sleep until an event is posted
+ *  @details The task then transitions as usual, and the transition dispatches
+ *           the event. On MSP430, the CPU sleeps in LIBCHAIN_EVENT_LPM_BITS
+ *           with interrupts enabled, so the interrupt handler that posts the
+ *           event must end with EVENT_WAKEUP. On the host, the process waits
+ *           for a signal, whose handler may post events. Not for use in the
+ *           tasks of a handler, which never see pending events.
+ */
+#define EVENT_WAIT() chain_event_wait()
+
+/** @brief Wake up from EVENT_WAIT on exit from the interrupt handler */
+#ifdef LIBCHAIN_HOST
+#define EVENT_WAKEUP()
+#else // !LIBCHAIN_HOST
+#define EVENT_WAKEUP() __bic_SR_register_on_exit(LIBCHAIN_EVENT_LPM_BITS)
+#endif // !LIBCHAIN_HOST
+
+int chain_event_post(unsigned priority, unsigned type, unsigned data);
+const chain_event_t *chain_event_current();
+void chain_event_return() __attribute__((noreturn));
+void chain_event_wait();
+
 /** @brief Internal macro for counting channel arguments to a variadic macro */
 #define NUM_CHANS(...) (sizeof((void *[]){__VA_ARGS__})/sizeof(void *))
 
@@ -339,25 +1156,25 @@ void chan_out(const char *field_name, const void *value,
  */
 // #define CHAN_IN1(field, chan0) (&(chan0->data.field.value))
 #define CHAN_IN1(type, field, chan0) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 1, \
+    ((type*)((unsigned char *)chan_in(#field, VAR_SIZE(type), 1, \
           chan0, offsetof(__typeof__(chan0->data), field))))
 #define CHAN_IN2(type, field, chan0, chan1) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 2, \
+    ((type*)((unsigned char *)chan_in(#field, VAR_SIZE(type), 2, \
           chan0, offsetof(__typeof__(chan0->data), field), \
           chan1, offsetof(__typeof__(chan1->data), field))))
 #define CHAN_IN3(type, field, chan0, chan1, chan2) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 3, \
+    ((type*)((unsigned char *)chan_in(#field, VAR_SIZE(type), 3, \
           chan0, offsetof(__typeof__(chan0->data), field), \
           chan1, offsetof(__typeof__(chan1->data), field), \
           chan2, offsetof(__typeof__(chan2->data), field))))
 #define CHAN_IN4(type, field, chan0, chan1, chan2, chan3) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 4, \
+    ((type*)((unsigned char *)chan_in(#field, VAR_SIZE(type), 4, \
           chan0, offsetof(__typeof__(chan0->data), field), \
           chan1, offsetof(__typeof__(chan1->data), field), \
           chan2, offsetof(__typeof__(chan2->data), field), \
           chan3, offsetof(__typeof__(chan3->data), field))))
 #define CHAN_IN5(type, field, chan0, chan1, chan2, chan3, chan4) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 5, \
+    ((type*)((unsigned char *)chan_in(#field, VAR_SIZE(type), 5, \
           chan0, offsetof(__typeof__(chan0->data), field), \
           chan1, offsetof(__typeof__(chan1->data), field), \
           chan2, offsetof(__typeof__(chan2->data), field), \
@@ -370,34 +1187,399 @@ void chan_out(const char *field_name, const void *value,
  *  multicast channel would show up as one argument here.
  */
 #define CHAN_OUT1(type, field, val, chan0) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 1, \
+    chan_out(#field, &val, VAR_SIZE(type), 1, \
              chan0, offsetof(__typeof__(chan0->data), field))
 #define CHAN_OUT2(type, field, val, chan0, chan1) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 2, \
+    chan_out(#field, &val, VAR_SIZE(type), 2, \
              chan0, offsetof(__typeof__(chan0->data), field), \
              chan1, offsetof(__typeof__(chan1->data), field))
 #define CHAN_OUT3(type, field, val, chan0, chan1, chan2) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 3, \
+    chan_out(#field, &val, VAR_SIZE(type), 3, \
              chan0, offsetof(__typeof__(chan0->data), field), \
              chan1, offsetof(__typeof__(chan1->data), field), \
              chan2, offsetof(__typeof__(chan2->data), field))
 #define CHAN_OUT4(type, field, val, chan0, chan1, chan2, chan3) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 4, \
+    chan_out(#field, &val, VAR_SIZE(type), 4, \
              chan0, offsetof(__typeof__(chan0->data), field), \
              chan1, offsetof(__typeof__(chan1->data), field), \
              chan2, offsetof(__typeof__(chan2->data), field), \
              chan3, offsetof(__typeof__(chan3->data), field))
 #define CHAN_OUT5(type, field, val, chan0, chan1, chan2, chan3, chan4) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 5, \
+    chan_out(#field, &val, VAR_SIZE(type), 5, \
              chan0, offsetof(__typeof__(chan0->data), field), \
              chan1, offsetof(__typeof__(chan1->data), field), \
              chan2, offsetof(__typeof__(chan2->data), field), \
              chan3, offsetof(__typeof__(chan3->data), field), \
              chan4, offsetof(__typeof__(chan4->data), field))
 
+/** @brief Write a value into a channel in place, without a copy
+ *  @details CHAN_OUT_BEGIN returns a pointer to the storage of the field in
+ *           the channel (for a self-channel, to the staging buffer), which
+ *           the task fills in, and CHAN_OUT_COMMIT publishes the value.
+ *
+ *           The storage of a task-to-task channel holds the value published
+ *           by the previous execution of the task until the commit, so if
+ *           power fails in between, the destination can observe a partially
+ *           overwritten value unless the task commits the field (or writes
+ *           it with CHAN_OUT) again on re-execution: every path through the
+ *           task that begins a write must commit it.
+ *
+ *           Self-channel writes are staged, so this hazard does not exist
+ *           for self-channels.
+ */
+#define CHAN_OUT_BEGIN(type, field, chan) \
+    ((type*)chan_out_begin(VAR_SIZE(type), CHAN_ARG(chan, field)))
+#define CHAN_OUT_COMMIT(type, field, chan) \
+    chan_out_commit(#field, VAR_SIZE(type), CHAN_ARG(chan, field))
+
+/** @brief Internal macros for the geometry of a block-versioned field */
+#define FIELD_BLOCK_SIZE(chan, field) \
+    (sizeof(chan->data.field.value) / \
+     (sizeof(chan->data.field.meta) / sizeof(var_meta_t)))
+#define FIELD_VALUE_OFFSET(chan, field) offsetof(__typeof__(chan->data.field), value)
+#define BLOCKS_ARGS(chan, field) FIELD_BLOCK_SIZE(chan, field), FIELD_VALUE_OFFSET(chan, field)
+#define CHAN_ARG(chan, field) chan, offsetof(__typeof__(chan->data), field)
+
+/** @brief Return a pointer to the most recently modified version of a block
+ *  @details For a CHAN_FIELD_BUFFER, the only block is block 0.
+ */
+#define CHAN_IN_BLOCK1(type, field, block, chan0) \
+    ((type*)chan_in_block(#field, block, BLOCKS_ARGS(chan0, field), 1, \
+          CHAN_ARG(chan0, field)))
+#define CHAN_IN_BLOCK2(type, field, block, chan0, chan1) \
+    ((type*)chan_in_block(#field, block, BLOCKS_ARGS(chan0, field), 2, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field)))
+#define CHAN_IN_BLOCK3(type, field, block, chan0, chan1, chan2) \
+    ((type*)chan_in_block(#field, block, BLOCKS_ARGS(chan0, field), 3, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field)))
+#define CHAN_IN_BLOCK4(type, field, block, chan0, chan1, chan2, chan3) \
+    ((type*)chan_in_block(#field, block, BLOCKS_ARGS(chan0, field), 4, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field), \
+          CHAN_ARG(chan3, field)))
+#define CHAN_IN_BLOCK5(type, field, block, chan0, chan1, chan2, chan3, chan4) \
+    ((type*)chan_in_block(#field, block, BLOCKS_ARGS(chan0, field), 5, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field), \
+          CHAN_ARG(chan3, field), CHAN_ARG(chan4, field)))
+
+/** @brief Copy count elements starting at index start into array dest
+ *  @details Each block is copied from the channel where it was most
+ *           recently modified.
+ */
+#define CHAN_IN_RANGE1(type, field, dest, start, count, chan0) \
+    chan_in_range(#field, dest, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 1, \
+          CHAN_ARG(chan0, field))
+#define CHAN_IN_RANGE2(type, field, dest, start, count, chan0, chan1) \
+    chan_in_range(#field, dest, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 2, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field))
+#define CHAN_IN_RANGE3(type, field, dest, start, count, chan0, chan1, chan2) \
+    chan_in_range(#field, dest, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 3, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field))
+#define CHAN_IN_RANGE4(type, field, dest, start, count, chan0, chan1, chan2, chan3) \
+    chan_in_range(#field, dest, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 4, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field), \
+          CHAN_ARG(chan3, field))
+#define CHAN_IN_RANGE5(type, field, dest, start, count, chan0, chan1, chan2, chan3, chan4) \
+    chan_in_range(#field, dest, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 5, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field), \
+          CHAN_ARG(chan3, field), CHAN_ARG(chan4, field))
+
+/** @brief Write count elements from array src starting at index start
+ *  @details One timestamp is written per block that the range overlaps.
+ */
+#define CHAN_OUT_RANGE1(type, field, src, start, count, chan0) \
+    chan_out_range(#field, src, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 1, \
+          CHAN_ARG(chan0, field))
+#define CHAN_OUT_RANGE2(type, field, src, start, count, chan0, chan1) \
+    chan_out_range(#field, src, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 2, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field))
+#define CHAN_OUT_RANGE3(type, field, src, start, count, chan0, chan1, chan2) \
+    chan_out_range(#field, src, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 3, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field))
+#define CHAN_OUT_RANGE4(type, field, src, start, count, chan0, chan1, chan2, chan3) \
+    chan_out_range(#field, src, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 4, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field), \
+          CHAN_ARG(chan3, field))
+#define CHAN_OUT_RANGE5(type, field, src, start, count, chan0, chan1, chan2, chan3, chan4) \
+    chan_out_range(#field, src, (start) * sizeof(type), (count) * sizeof(type), \
+          BLOCKS_ARGS(chan0, field), 5, \
+          CHAN_ARG(chan0, field), CHAN_ARG(chan1, field), CHAN_ARG(chan2, field), \
+          CHAN_ARG(chan3, field), CHAN_ARG(chan4, field))
+
+/** @brief Declare a join field: a field of a task with tracked latest writer
+ *  @param dest     Name of the task that reads the field
+ *  @param field    Name of the field (not an array element)
+ *  @details A field that a task reads from many channels (CHAN_IN with many
+ *           channels) costs a timestamp comparison per channel on every read.
+ *           Instead, writers can record which channel they wrote, so that the
+ *           read is a single indirection. All writes into the channels that
+ *           carry the field to the destination must then go through
+ *           CHAN_OUT_JOIN*, and the field must be written before it is read.
+ */
+#define JOIN_SYM_NAME(dest, field) _join_ ## dest ## _ ## field
+#define JOIN_FIELD(dest, field) \
+    __nv join_field_t JOIN_SYM_NAME(dest, field) = { NULL }
+#define JOIN(dest, field) (&JOIN_SYM_NAME(dest, field))
+
+/** @brief Read a join field of the current task
+ *  @details The _SELF variant also considers the self-channel of the task,
+ *           with which the field is carried back to the same task.
+ */
+#define CHAN_IN_JOIN(type, field, dest) \
+    ((type*)chan_in_join(#field, VAR_SIZE(type), JOIN(dest, field), NULL, 0))
+#define CHAN_IN_JOIN_SELF(type, field, dest, self_chan) \
+    ((type*)chan_in_join(#field, VAR_SIZE(type), JOIN(dest, field), \
+        self_chan, offsetof(__typeof__(self_chan->data), field)))
+
+/** @brief Write a value into a channel and record it as the latest writer
+ *  @details The destinations are the tasks that have a join field for this
+ *           field, and are reached by the channel: one for a task-to-task
+ *           channel, up to all of them for a multicast channel. Not for
+ *           self-channels, which the reader checks directly.
+ */
+#define CHAN_OUT_JOIN1(type, field, val, chan, dest0) \
+    chan_out_join(#field, &val, VAR_SIZE(type), \
+                  chan, offsetof(__typeof__(chan->data), field), 1, \
+                  JOIN(dest0, field))
+#define CHAN_OUT_JOIN2(type, field, val, chan, dest0, dest1) \
+    chan_out_join(#field, &val, VAR_SIZE(type), \
+                  chan, offsetof(__typeof__(chan->data), field), 2, \
+                  JOIN(dest0, field), JOIN(dest1, field))
+#define CHAN_OUT_JOIN3(type, field, val, chan, dest0, dest1, dest2) \
+    chan_out_join(#field, &val, VAR_SIZE(type), \
+                  chan, offsetof(__typeof__(chan->data), field), 3, \
+                  JOIN(dest0, field), JOIN(dest1, field), JOIN(dest2, field))
+#define CHAN_OUT_JOIN4(type, field, val, chan, dest0, dest1, dest2, dest3) \
+    chan_out_join(#field, &val, VAR_SIZE(type), \
+                  chan, offsetof(__typeof__(chan->data), field), 4, \
+                  JOIN(dest0, field), JOIN(dest1, field), JOIN(dest2, field), \
+                  JOIN(dest3, field))
+#define CHAN_OUT_JOIN5(type, field, val, chan, dest0, dest1, dest2, dest3, dest4) \
+    chan_out_join(#field, &val, VAR_SIZE(type), \
+                  chan, offsetof(__typeof__(chan->data), field), 5, \
+                  JOIN(dest0, field), JOIN(dest1, field), JOIN(dest2, field), \
+                  JOIN(dest3, field), JOIN(dest4, field))
+
 /** @brief Transfer control to the given task
  *  @param task     Name of the task function
  *  */
 #define TRANSITION_TO(task) transition_to(TASK_REF(task))
 
+/** @brief Maximum depth of nested calls */
+#ifndef LIBCHAIN_CALL_DEPTH
+#define LIBCHAIN_CALL_DEPTH 8
+#endif
+
+/** @brief Transfer control to a callable task, to continue at a task of the
+ *         caller when the callee returns
+ *  @param callee   Name of the first task of the called subgraph
+ *  @param ret      Name of the task that TRANSITION_RETURN transfers to
+ *  @details The return task is pushed onto a call stack in non-volatile
+ *           memory, whose depth is part of the context, so the push and the
+ *           pop commit with the transition that makes them. Arguments and
+ *           results are passed through CALL_CH(callee) and RET_CH(callee).
+ */
+#define TRANSITION_CALL(callee, ret) transition_call(TASK_REF(callee), TASK_REF(ret))
+
+/** @brief Transfer control to the return task of the innermost call
+ *  @details Any task of the called subgraph may return.
+ */
+#define TRANSITION_RETURN() transition_return()
+
+void transition_call(const task_t *callee, const task_t *ret);
+void transition_return();
+
+#ifdef LIBCHAIN_ENABLE_SLEEP
+/** @brief Transfer control to the given task after a delay
+ *  @param task     Name of the task function
+ *  @param delay_ms Delay in milliseconds, measured by chain_clock
+ *  @details Available only if LIBCHAIN_ENABLE_SLEEP is defined, because on
+ *           MSP430 the library then takes the interrupt vector of the sleep
+ *           timer. The transition commits immediately, and the device
+ *           sleeps until the deadline before the task starts. A reboot
+ *           during the sleep resumes it, so the task starts no earlier than
+ *           the delay after the transition, counting only the time that the
+ *           device was powered. Events are not dispatched by this
+ *           transition: those posted during the sleep are dispatched after
+ *           it.
+ */
+#define TRANSITION_AFTER(task, delay_ms) transition_after(TASK_REF(task), delay_ms)
+
+void transition_after(const task_t *task, uint32_t delay_ms);
+
+/** @brief Period of the sleep timer, in milliseconds
+ *  @details The persistent clock is advanced once per period, so a reboot
+ *           during a sleep repeats at most one period of it.
+ */
+#ifndef LIBCHAIN_SLEEP_PERIOD_MS
+#define LIBCHAIN_SLEEP_PERIOD_MS 100
+#endif
+
+/** @brief Instance of Timer A used for sleeping (MSP430), clocked by ACLK */
+#ifndef LIBCHAIN_SLEEP_TIMER
+#define LIBCHAIN_SLEEP_TIMER 2
+#endif
+
+/** @brief Frequency of ACLK, in Hz (MSP430) */
+#ifndef LIBCHAIN_ACLK_HZ
+#define LIBCHAIN_ACLK_HZ 32768
+#endif
+
+/** @brief Persistent estimate of time, in milliseconds
+ *  @details Advanced by the sleeps of TRANSITION_AFTER, from which it is
+ *           measured exactly. There is no clock that runs without power, so
+ *           time spent off is not counted. Wraps around after 2^32 ms.
+ */
+uint32_t chain_clock();
+#endif // LIBCHAIN_ENABLE_SLEEP
+
+/** @brief Save the progress of the current execution of the task
+ *  @param  state   variable of the type declared by CHECKPOINT for the task
+ *  @details For a long task that would otherwise restart from its beginning
+ *           after a power failure: the task resumes from its latest
+ *           checkpoint, with the locals that it keeps in the state,
+ *           instead. The writes into self-channels made before the
+ *           checkpoint are kept, the ones made after it are discarded, as
+ *           on a restart, including the writes of fields that were written
+ *           before the checkpoint too (see the undo log of CHECKPOINT).
+ *           Writes into other channels are made in place, and are repeated
+ *           by the re-execution from the checkpoint:
+ *
+ *               struct progress p;
+ *               if (!TASK_RESUME(p))
+ *                   p.i = 0;
+ *               for (; p.i < n; ++p.i) {
+ *                   if (p.i % 16 == 0)
+ *                       TASK_CHECKPOINT(p);
+ *                   ...
+ *               }
+ *
+ *           A checkpoint is valid only in the execution that took it: the
+ *           next execution of the task starts from the beginning.
+ */
+#define TASK_CHECKPOINT(state) task_checkpoint(&(state), sizeof(state))
+
+/** @brief Restore the state saved by the latest checkpoint of this execution
+ *  @return Non-zero if restored, zero if the execution has no checkpoint
+ */
+#define TASK_RESUME(state) task_resume(&(state), sizeof(state))
+
+void task_checkpoint(const void *state, size_t size);
+int task_resume(void *state, size_t size);
+void task_checkpoint_save(self_field_meta_t *self_field, var_meta_t *var, size_t var_size);
+
+/* Internal: fail point between writes in the inline functions */
+#ifdef LIBCHAIN_HOST
+#define CHAIN_FAIL_POINT() chain_host_fail_point()
+#else // !LIBCHAIN_HOST
+#define CHAIN_FAIL_POINT()
+#endif // !LIBCHAIN_HOST
+
+/** @brief Prepare a write to the staging buffer of a self-channel field (internal)
+ *  @param idx_pair value of the index pair of the field, read by the caller
+ *  @param var      staging buffer of the field (per SELF_CHAN_IDX_BIT_NEXT)
+ *  @param enqueue  whether to enqueue the field for swap
+ *  @details Shared by chan_out and the C++ front end (chain.hpp).
+ */
+static inline void chain_self_out(self_field_meta_t *self_field, unsigned idx_pair,
+                                  var_meta_t *var, size_t var_size, int enqueue)
+{
+    // The staged value belongs to the latest checkpoint. The save
+    // changes only that bit, which only a dirty field has.
+    if (idx_pair & SELF_CHAN_IDX_BIT_CHECKPOINT_CURRENT)
+        task_checkpoint_save(self_field, var, var_size);
+
+    // A field already marked dirty is already in the list
+    if (!enqueue || (idx_pair & SELF_CHAN_IDX_BIT_DIRTY_CURRENT))
+        return;
+
+    // "Enqueue" the buffer index to be flipped on next transition:
+    //   (1) add the field to the list of dirty fields
+    //   (2) initialize the dirty bit for next swap, or, in other words,
+    //       "finalize" clearing of the dirty bit from the previous
+    //       swap, since the swap "clears" the dirty bit by moving
+    //       it over from LSB to MSB.
+    //   (3) mark the index dirty, which enques the swap
+    //
+    // NOTE: a field is marked only after it is listed, so that the
+    // prologue can unmark all marked fields on restart. Repeating
+    // the sequence after a reboot is harmless. Counter of the dirty
+    // list is reset in task prologue.
+    const task_t *curtask = chain_task;
+    unsigned n = curtask->state->num_dirty_self_fields;
+    curtask->dirty_self_fields[n] = self_field;
+    curtask->state->num_dirty_self_fields = n + 1;
+    CHAIN_FAIL_POINT();
+    self_field->idx_pair = (idx_pair & ~(SELF_CHAN_IDX_BIT_DIRTY_NEXT |
+                                         SELF_CHAN_IDX_BIT_CHECKPOINT_NEXT)) |
+                           SELF_CHAN_IDX_BIT_DIRTY_CURRENT;
+    CHAIN_FAIL_POINT();
+}
+
+/** @brief Upper bound on the iterations of a BATCH_LOOP in one execution */
+#ifndef LIBCHAIN_BATCH_MAX
+#define LIBCHAIN_BATCH_MAX 64
+#endif
+
+/** @brief Run a batch of iterations of a loop in one execution of a task
+ *  @details For a task that transitions to itself once per iteration of a
+ *           loop, with the induction state in its self-channel: the task
+ *           reads the state, runs the iterations in local variables, writes
+ *           the state, and transitions to itself, so the transition cost is
+ *           paid once per batch:
+ *
+ *               unsigned i = *CHAN_IN1(unsigned, i, SELF_IN_CH(task));
+ *               BATCH_LOOP(i < n) {
+ *                   ...; ++i;
+ *               }
+ *               CHAN_OUT1(unsigned, i, i, SELF_OUT_CH(task));
+ *               TRANSITION_TO(task);
+ *
+ *           The body must not write to channels. The number of iterations
+ *           per batch is tuned by the runtime for each task: it grows by one
+ *           with each execution that completes, up to LIBCHAIN_BATCH_MAX,
+ *           and halves on each restart, down to one, i.e. the cost of one
+ *           iteration per execution, so that the task makes progress
+ *           whatever the energy supply.
+ */
+#define BATCH_LOOP(cond) \
+    for (unsigned _batch_left = chain_batch_begin(); _batch_left && (cond); --_batch_left)
+
+unsigned chain_batch_begin();
+
+/* Internal: reboot path shared by the entry points */
+const task_t *chain_boot();
+
+#ifdef LIBCHAIN_HOST
+/* Internal: interface between the runtime and the host backend */
+int chain_host_main();
+void chain_host_transition(const task_t *next_task) __attribute__((noreturn));
+void chain_host_wait(volatile unsigned *flag);
+void chain_host_sleep(uint32_t ms);
+#endif // LIBCHAIN_HOST
+
+#ifdef __cplusplus
+} // extern "C"
+
+template <typename type>
+struct _chain_var_type {
+    var_meta_t meta;
+    type value;
+};
+
+/* Kind of a channel, see CHAN_KIND_MARK */
+template <typename chan_type>
+struct _chain_chan_kind {
+    static const int value = CHAN_TYPE_T2T;
+};
+#endif // __cplusplus
+
 #endif // CHAIN_H
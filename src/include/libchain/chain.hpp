@@ -0,0 +1,238 @@
+#ifndef CHAIN_HPP
+#define CHAIN_HPP
+
+/** @file
+ *  @brief Type-safe C++17 front end for channel access
+ *
+ *  The C macros (CHAN_IN*, CHAN_OUT*) funnel into the variadic chan_in/chan_out,
+ *  which decode the channel list, the channel type, and the value size at
+ *  runtime. Here, the field, the kind of each channel (self or not), and the
+ *  size of the value are template parameters, so each access compiles into
+ *  straight-line code specific to the call site. The functions operate on the
+ *  same channel objects (declared by CHANNEL, SELF_CHANNEL, etc.) and with the
+ *  same semantics as the C interface, so the two can be mixed freely.
+ *
+ *  The field is identified either by a pointer to member, when all channels
+ *  carry the same message type:
+ *
+ *      unsigned x = *chain::in<&msg_type::x>(CH(task_a, task_b));
+ *      chain::out<&msg_type::x>(x, CH(task_b, task_c), CH(task_b, task_d));
+ *
+ *  or by name, when the channels carry different message types (which is
+ *  always the case when a self-channel is involved):
+ *
+ *      unsigned x = *CHAIN_IN(x, CH(task_a, task_b), SELF_IN_CH(task_b));
+ *      CHAIN_OUT(x, x, SELF_OUT_CH(task_b));
+ *
+ *  The accesses go through chan_in and chan_out instead when the library is
+ *  built with an option that acts on each access (the channel cache,
+ *  diagnostics, trace or profile, see chain_chan_hooks), and for the kinds of
+ *  channels that the C interface handles at runtime (see chan_via_c), which
+ *  their declarations record (see CHAN_KIND_MARK). Writes are counted
+ *  (LIBCHAIN_ENABLE_COUNTERS) as in the C interface.
+ */
+
+#include <string.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "chain.h"
+
+namespace chain {
+
+namespace detail {
+
+template <typename T> struct member_pointer;
+template <typename T, typename C> struct member_pointer<T C::*> {
+    using field_type = T;
+    using class_type = C;
+};
+
+/** @brief Self-channel fields are the ones that carry a self_field_meta_t */
+template <typename Field, typename = void>
+struct is_self_field : std::false_type {};
+template <typename Field>
+struct is_self_field<Field, std::void_t<decltype(std::declval<Field &>().meta)>>
+    : std::true_type {};
+
+/** @brief Whether a channel is of a kind that the C interface handles
+ *  @details The C interface tells the kinds apart at runtime: redo-log
+ *           self-channels, volatile channels, whose tag it checks and sets,
+ *           and channels into a task that carry the message type of its
+ *           self-channel.
+ */
+template <typename Access, typename Chan>
+constexpr bool chan_via_c()
+{
+    using field_t = std::remove_reference_t<
+        decltype(std::declval<Access &>()(std::declval<Chan &>().data))>;
+    constexpr int kind = _chain_chan_kind<Chan>::value;
+
+    return kind == CHAN_TYPE_SELF_LOG || kind == CHAN_TYPE_VOLATILE ||
+           is_self_field<field_t>::value != (kind == CHAN_TYPE_SELF);
+}
+
+/** @brief Whether an access to the channels goes through the C interface */
+template <typename Access, typename... Chans>
+inline bool via_c()
+{
+    return (chan_via_c<Access, Chans>() || ...) || CHAIN_CHAN_HOOKS || chain_chan_hooks;
+}
+
+template <typename Access, typename Chan>
+inline size_t field_offset(Access access, Chan *chan)
+{
+    return (size_t)((uint8_t *)&access(chan->data) - (uint8_t *)&chan->data);
+}
+
+template <typename Field>
+inline auto *var_in(Field &field)
+{
+    if constexpr (is_self_field<Field>::value)
+        return &field.var[(field.meta.idx_pair & SELF_CHAN_IDX_BIT_CURRENT) ? 1 : 0];
+    else
+        return &field.var;
+}
+
+template <typename Field>
+inline auto *var_out(Field &field)
+{
+    if constexpr (is_self_field<Field>::value) {
+        self_field_meta_t *self_field = &field.meta;
+        unsigned idx_pair = self_field->idx_pair;
+        auto *var = &field.var[(idx_pair & SELF_CHAN_IDX_BIT_NEXT) ? 1 : 0];
+
+        chain_self_out(self_field, idx_pair, &var->meta, sizeof(*var), 1);
+        return var;
+    } else {
+        return &field.var;
+    }
+}
+
+template <typename Var, typename T>
+inline void store(Var *var, const T &value)
+{
+    chain_stamp(&var->meta);
+    CHAIN_FAIL_POINT();
+    if constexpr (std::is_array_v<T>)
+        memcpy(var->value, value, sizeof(value));
+    else
+        var->value = value;
+#ifdef LIBCHAIN_ENABLE_COUNTERS
+    chain_task->counters->bytes_written += sizeof(*var) - sizeof(var_meta_t);
+#endif // LIBCHAIN_ENABLE_COUNTERS
+}
+
+/** @brief Write through chan_out, with the value converted to the field type */
+template <typename Var, typename T, typename Chan>
+inline void store_c(const T &value, Chan *chan, size_t offset)
+{
+    if constexpr (std::is_array_v<T>) {
+        chan_out("", value, sizeof(Var), 1, chan, offset);
+    } else {
+        const decltype(Var::value) v = value;
+        chan_out("", &v, sizeof(Var), 1, chan, offset);
+    }
+}
+
+template <typename Access, typename T, typename Chan>
+inline void out_one(Access access, const T &value, Chan *chan)
+{
+    auto &field = access(chan->data);
+    using var_t = std::remove_pointer_t<decltype(var_in(field))>;
+
+    if (via_c<Access, Chan>())
+        store_c<var_t>(value, chan, field_offset(access, chan));
+    else
+        store(var_out(field), value);
+}
+
+} // namespace detail
+
+/** @brief Read the most recently modified value of a field from the given channels
+ *  @param access   callable that maps a message to the field in it
+ *  @param chans    channel pointers (CH(), SELF_IN_CH(), MC_IN_CH(), ...)
+ *  @return Pointer to the value
+ */
+template <typename Access, typename Chan, typename... Chans>
+inline auto *in(Access access, Chan *chan, Chans *...chans)
+{
+    using var_t = std::remove_pointer_t<decltype(detail::var_in(access(chan->data)))>;
+    using value_t = decltype(var_t::value);
+
+    if (detail::via_c<Access, Chan, Chans...>()) {
+        return std::apply([](auto... args) {
+            return (value_t *)chan_in("", sizeof(var_t), 1 + sizeof...(chans), args...);
+        }, std::tuple_cat(std::make_tuple(chan, detail::field_offset(access, chan)),
+                          std::make_tuple(chans, detail::field_offset(access, chans))...));
+    }
+
+    auto *latest = detail::var_in(access(chan->data));
+
+    if constexpr (sizeof...(chans) > 0) {
+        const var_meta_t *latest_meta = &latest->meta;
+        chain_time_t latest_age = chain_stamp_age(latest_meta->timestamp);
+        value_t *latest_value = &latest->value;
+
+        ([&] {
+            auto *var = detail::var_in(access(chans->data));
+            static_assert(std::is_same_v<std::remove_reference_t<decltype(var->value)>,
+                                         value_t>,
+                          "field has different types in different channels");
+            chain_time_t age = chain_stamp_age(var->meta.timestamp);
+            if (chain_stamp_newer(&var->meta, age, latest_meta, latest_age)) {
+                latest_meta = &var->meta;
+                latest_age = age;
+                latest_value = &var->value;
+            }
+        }(), ...);
+
+        return latest_value;
+    } else {
+        return &latest->value;
+    }
+}
+
+/** @brief Write a value to a field in the given channels
+ *  @param access   callable that maps a message to the field in it
+ *  @param value    value to write
+ *  @param chans    channel pointers (CH(), SELF_OUT_CH(), MC_OUT_CH(), ...)
+ */
+template <typename Access, typename T, typename... Chans>
+inline void out(Access access, const T &value, Chans *...chans)
+{
+    (detail::out_one(access, value, chans), ...);
+}
+
+template <auto Field, typename... Chans>
+inline auto *in(Chans *...chans)
+{
+    using msg_type = typename detail::member_pointer<decltype(Field)>::class_type;
+    static_assert((std::is_same_v<std::remove_reference_t<decltype(chans->data)>,
+                                  msg_type> && ...),
+                  "channel carries a different message type than the field");
+    return in([](msg_type &msg) -> auto & { return msg.*Field; }, chans...);
+}
+
+template <auto Field, typename T, typename... Chans>
+inline void out(const T &value, Chans *...chans)
+{
+    using msg_type = typename detail::member_pointer<decltype(Field)>::class_type;
+    static_assert((std::is_same_v<std::remove_reference_t<decltype(chans->data)>,
+                                  msg_type> && ...),
+                  "channel carries a different message type than the field");
+    out([](msg_type &msg) -> auto & { return msg.*Field; }, value, chans...);
+}
+
+} // namespace chain
+
+/** @brief Read a field by name from channels that carry different message types */
+#define CHAIN_IN(field, ...) \
+    chain::in([](auto &msg) -> auto & { return msg.field; }, __VA_ARGS__)
+
+/** @brief Write a field by name to channels that carry different message types */
+#define CHAIN_OUT(field, val, ...) \
+    chain::out([](auto &msg) -> auto & { return msg.field; }, val, __VA_ARGS__)
+
+#endif // CHAIN_HPP
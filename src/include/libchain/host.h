@@ -0,0 +1,201 @@
+#ifndef LIBCHAIN_HOST_H
+#define LIBCHAIN_HOST_H
+
+/** @file
+ *  @brief Host (x86-64 Linux) backend: simulated non-volatile memory and
+ *         power-failure injection harness
+ *
+ *  In the host build (LIBCHAIN_HOST defined when compiling libchain *and* the
+ *  application), persistent variables are collected into a dedicated linker
+ *  section that the runtime maps onto a file on first boot, so that its
+ *  contents survive both the simulated power failures and restarts of the
+ *  process. Everything outside the section (stack, SRAM globals) plays the
+ *  role of volatile memory, with one caveat: the harness resets only the
+ *  stack on a simulated power failure, so applications must not rely on
+ *  non-__nv globals being re-initialized by a reboot. Persistent state holds
+ *  pointers, so for it to survive process restarts, the application must be
+ *  linked with -no-pie.
+ *
+ *  The harness is configured either programmatically, before chain_main is
+ *  called, or from the environment:
+ *
+ *    LIBCHAIN_HOST_NV_FILE          path of the file backing __nv memory
+ *    LIBCHAIN_HOST_FAIL_EVERY       fail after every N failure points
+ *    LIBCHAIN_HOST_FAIL_RANDOM      fail after a random number of failure
+ *                                   points, uniform in [1, 2N - 1]
+ *    LIBCHAIN_HOST_FAIL_TRACE       file with one interval (in failure points)
+ *                                   per line, consumed one per boot
+ *    LIBCHAIN_HOST_SEED             seed for LIBCHAIN_HOST_FAIL_RANDOM
+ *    LIBCHAIN_HOST_MAX_BOOTS        stop after this many simulated boots
+ *    LIBCHAIN_HOST_MAX_TRANSITIONS  stop after this many transitions
+ *    LIBCHAIN_HOST_STATS            print run statistics on stop if set
+ *
+ *  A failure point is any point in the runtime where losing power is
+ *  interesting (between the individual non-volatile stores of a primitive)
+ *  plus any CHAIN_HOST_TICK() placed by the application into task code.
+ *  Instruction-granularity failures are not modeled: the application should
+ *  sprinkle CHAIN_HOST_TICK() into long computations to get failures there.
+ *
+ *  Instead of after a number of failure points, power can fail when the
+ *  energy stored in a simulated capacitor runs out (see chain_host_energy_t):
+ *
+ *    LIBCHAIN_HOST_ENERGY_TRACE     file of harvested power, one segment per
+ *                                   line: duration (s) and power (W)
+ *    LIBCHAIN_HOST_ENERGY_POWER     constant harvested power (W), if no trace
+ *    LIBCHAIN_HOST_ENERGY_CAP_UF    capacitance (uF)
+ *    LIBCHAIN_HOST_ENERGY_V_ON      turn-on voltage (V)
+ *    LIBCHAIN_HOST_ENERGY_V_OFF     brown-out voltage (V)
+ *    LIBCHAIN_HOST_ENERGY_CLOCK_HZ  CPU clock (Hz)
+ *    LIBCHAIN_HOST_ENERGY_NJ_CYCLE  energy per CPU cycle (nJ)
+ *    LIBCHAIN_HOST_ENERGY_NJ_NV     energy per NV access on top of its cycles (nJ)
+ *    LIBCHAIN_HOST_ENERGY_TICK      cycles charged per CHAIN_HOST_TICK()
+ *    LIBCHAIN_HOST_ENERGY_POINT     cycles charged per failure point in the runtime
+ *    LIBCHAIN_HOST_ENERGY_BOOT      cycles charged per boot
+ *    LIBCHAIN_HOST_ENERGY_COUNT_NV  charge NV accesses as counted (slow), if set
+ *
+ *  Many instances of the application can be run in parallel, each in a
+ *  process of its own (the runtime state is global), either from the
+ *  environment, with the seed incremented per instance:
+ *
+ *    LIBCHAIN_HOST_FLEET            number of instances
+ *    LIBCHAIN_HOST_JOBS             instances run at a time (default: CPUs)
+ *
+ *  or with a configuration per instance, with chain_host_fleet.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Persistent variable: placed into the file-backed section */
+#define __nv __attribute__((section("chain_nv")))
+
+/** @brief Metadata alignment that covers values up to pointer/double size */
+#define LIBCHAIN_META_ALIGN __attribute__((aligned(8)))
+
+typedef enum {
+    CHAIN_HOST_FAIL_NONE,
+    CHAIN_HOST_FAIL_EVERY,
+    CHAIN_HOST_FAIL_RANDOM,
+    CHAIN_HOST_FAIL_TRACE,
+    CHAIN_HOST_FAIL_ENERGY,
+} chain_host_fail_mode_t;
+
+/** @brief Energy model for CHAIN_HOST_FAIL_ENERGY
+ *  @details The device runs from a capacitor that the harvester charges at
+ *           all times. It turns on when the voltage reaches v_on and fails
+ *           when it drops below v_off. Energy is charged at failure points:
+ *           a failure point in the runtime stands for point_cycles cycles
+ *           and one NV access (or the NV accesses counted since the last
+ *           point, with count_nv), and CHAIN_HOST_TICK for tick_cycles
+ *           cycles. Time advances by the cycles charged while on and by the
+ *           time taken to recharge while off.
+ *
+ *           Fields left zero take defaults for an MSP430FR5969 at 8 MHz on
+ *           a 47 uF capacitor. The trace is replayed in a loop, from a point
+ *           chosen by the seed if the seed is not zero.
+ */
+typedef struct {
+    const char *trace;              // NULL: constant power
+    double power_w;
+
+    double capacitance_f;
+    double v_on;
+    double v_off;
+
+    double clock_hz;
+    double j_per_cycle;
+    double j_per_nv_access;
+    unsigned long tick_cycles;
+    unsigned long point_cycles;
+    unsigned long boot_cycles;
+    int count_nv;
+} chain_host_energy_t;
+
+typedef struct {
+    const char *nv_file;            // NULL: keep __nv memory in the process only
+
+    chain_host_fail_mode_t fail_mode;
+    unsigned long fail_interval;    // for EVERY and RANDOM modes
+    const char *fail_trace;         // for TRACE mode
+    unsigned seed;
+
+    chain_host_energy_t energy;     // for ENERGY mode
+
+    unsigned long max_boots;        // 0: unlimited
+    unsigned long max_transitions;  // 0: unlimited
+
+    unsigned fleet;                 // instances run by chain_main, 0 or 1: one
+    unsigned jobs;                  // instances run at a time, 0: one per CPU
+
+    int print_stats;
+} chain_host_config_t;
+
+typedef struct {
+    unsigned long boots;
+    unsigned long power_failures;
+    unsigned long transitions;
+    unsigned long fail_points;
+    double elapsed_sec;
+
+    // ENERGY mode only
+    double energy_j;                // consumed
+    double wasted_j;                // by executions that a failure discarded
+    double sim_time_sec;            // simulated time, off periods included
+} chain_host_stats_t;
+
+/** @brief Override the configuration read from the environment
+ *  @details Must be called before chain_main.
+ */
+void chain_host_configure(const chain_host_config_t *config);
+
+/** @brief Statistics of the current run */
+const chain_host_stats_t *chain_host_stats();
+
+/** @brief Run instances of the application in parallel, one per configuration
+ *  @param results  statistics of each instance at its stop
+ *  @return 0 if all instances stopped normally, -1 otherwise
+ *  @details Called by main after init() instead of chain_main. Each instance
+ *           runs in a child process, which starts from the __nv state at
+ *           the time of the call, or from its own file (instances must not
+ *           share a file).
+ */
+int chain_host_fleet(const chain_host_config_t *configs, unsigned count,
+                     unsigned jobs, chain_host_stats_t *results);
+
+/** @brief Failure point: may simulate a power failure (does not return then) */
+void chain_host_fail_point();
+
+/** @brief Failure point in application code, charged as computation */
+void chain_host_tick();
+
+/** @brief Simulate a power failure now: reboot through init() (does not return) */
+void chain_host_power_failure();
+
+/** @brief Stop the run: chain_main returns to its caller */
+void chain_host_halt();
+
+/** @brief Start or stop counting accesses to __nv memory
+ *  @return 0 on success, -1 if counting is not supported on this host
+ *  @details While counting, the pages that hold the __nv section are
+ *           protected, and every instruction that accesses them is trapped
+ *           and single-stepped, which is slow. An instruction that accesses
+ *           several words (e.g. in memcpy) counts once. Accesses by system
+ *           calls fail with EFAULT instead, so do not pass buffers in those
+ *           pages to system calls while counting.
+ */
+int chain_host_count_nv(int enable);
+
+/** @brief Number of instructions that read/wrote __nv memory while counting */
+void chain_host_nv_counts(unsigned long *reads, unsigned long *writes);
+
+/** @brief Failure point to be placed by the application in task code */
+#define CHAIN_HOST_TICK() chain_host_tick()
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // LIBCHAIN_HOST_H
@@ -0,0 +1,85 @@
+"""Access to an image of the non-volatile memory of a Chain application.
+
+The image is either a raw dump of memory starting at a given base address
+(e.g. of FRAM, saved by a debugger), or the file that backs __nv memory in
+the host backend (LIBCHAIN_HOST_NV_FILE), which records its own base.
+Variables are located by the symbols of the application binary.
+"""
+
+import os
+import struct
+import subprocess
+import sys
+
+HOST_TRAILER_FORMAT = '<QQ'  # nv_begin, nv_size
+HOST_PAGE_SIZE = 4096
+
+
+def read_symbols(elf, nm):
+    """Map of symbol name to address of the data symbols of the binary"""
+    out = subprocess.run([nm, elf], check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    symbols = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] in 'bBdDgGsSvV':
+            symbols[fields[2]] = int(fields[0], 16)
+    return symbols
+
+
+def with_prefix(symbols, prefix):
+    """Map of symbol name without the prefix to address"""
+    return {name[len(prefix):]: addr for name, addr in symbols.items()
+            if name.startswith(prefix)}
+
+
+class Image:
+    def __init__(self, path, base=None):
+        with open(path, 'rb') as f:
+            data = f.read()
+        if base is None:
+            trailer_size = struct.calcsize(HOST_TRAILER_FORMAT)
+            nv_begin, _ = struct.unpack(HOST_TRAILER_FORMAT, data[-trailer_size:])
+            data = data[:-trailer_size]
+            base = nv_begin & ~(HOST_PAGE_SIZE - 1)
+        self.data = data
+        self.base = base
+
+    def unpack(self, fmt, addr, what):
+        offset = addr - self.base
+        if offset < 0 or offset + struct.calcsize(fmt) > len(self.data):
+            sys.exit("%s at 0x%x is not in the image" % (what, addr))
+        return struct.unpack_from(fmt, self.data, offset)
+
+
+def add_arguments(parser):
+    """Arguments common to the tools that read an image"""
+    parser.add_argument('elf', help='application binary')
+    parser.add_argument('image', help='image of non-volatile memory')
+    parser.add_argument('--base', type=lambda s: int(s, 0),
+                        help='address of the first byte of a raw image')
+    parser.add_argument('--nm', default=os.environ.get('NM', 'nm'),
+                        help='nm for the target (e.g. msp430-elf-nm)')
+
+
+class HexDump:
+    """Image assembled from lines of "address bytes", both in hex"""
+
+    def __init__(self, path):
+        self.ranges = []
+        with open(path) as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) != 2:
+                    continue
+                try:
+                    self.ranges.append((int(fields[0], 16), bytes.fromhex(fields[1])))
+                except ValueError:
+                    continue  # other output of the application
+
+    def unpack(self, fmt, addr, what):
+        size = struct.calcsize(fmt)
+        for base, data in self.ranges:
+            if base <= addr and addr + size <= base + len(data):
+                return struct.unpack_from(fmt, data, addr - base)
+        sys.exit("%s at 0x%x is not in the dump" % (what, addr))